@@ -0,0 +1,226 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <SDL3/SDL_main.h>
+#include <SDL3/SDL_timer.h>
+
+#include "L_log.h"
+#include "L_memory.h"
+#include "old_maps.h"
+
+// Compares HashMap and IntMap against their pre-Robin Hood versions.
+// Usage: bench_maps [items] [rounds]
+
+#define KEY_SIZE 16
+
+static size_t num_items = 100000, num_rounds = 5;
+static char* keys = NULL; // 2 * num_items keys, the second half never inserted up front
+static uint32_t* int_keys = NULL;
+static volatile uintptr_t sink = 0;
+
+// L_memory.c only needs these from L_log.c
+const char* src_basename(const char* path) {
+    return path;
+}
+
+void log_generic(const char* filename, int line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    SDL_LogMessageV(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO, format, args);
+    va_end(args);
+}
+
+void log_fatal(const char* filename, int line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    SDL_LogMessageV(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_CRITICAL, format, args);
+    va_end(args);
+    SDL_Log("(%s:%d)", filename, line);
+    exit(EXIT_FAILURE);
+}
+
+static const char* key(size_t i) {
+    return &keys[i * KEY_SIZE];
+}
+
+static double ns_per_op(uint64_t start, size_t ops) {
+    return (double)(SDL_GetTicksNS() - start) / (double)ops;
+}
+
+static void report(const char* name, double old_ns, double new_ns) {
+    SDL_Log("%-16s %10.1f %10.1f %8.2fx", name, old_ns, new_ns, old_ns / new_ns);
+}
+
+// Every pass runs "num_rounds" times on a fresh map and keeps the best time
+enum BenchPasses {
+    BP_INSERT,
+    BP_HIT,
+    BP_MISS,
+    BP_CHURN,
+    BP_SIZE,
+};
+
+static const char* pass_names[BP_SIZE] = {"insert", "hit", "miss", "pop/insert"};
+
+static void bench_old_hash_map(double* results) {
+    for (size_t round = 0; round < num_rounds; round++) {
+        struct OldHashMap* map = old_create_hash_map();
+
+        uint64_t start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            old_to_hash_map(map, key(i), (void*)(i + 1));
+        results[BP_INSERT] = SDL_min(results[BP_INSERT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)old_from_hash_map(map, key(i));
+        results[BP_HIT] = SDL_min(results[BP_HIT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)old_from_hash_map(map, key(num_items + i));
+        results[BP_MISS] = SDL_min(results[BP_MISS], ns_per_op(start, num_items));
+
+        // Steady size, keys cycling through the whole set like actors and
+        // assets coming and going
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items * 2; i++) {
+            sink += (uintptr_t)old_pop_hash_map(map, key(i % (num_items * 2)));
+            old_to_hash_map(map, key((i + num_items) % (num_items * 2)), (void*)(i + 1));
+        }
+        results[BP_CHURN] = SDL_min(results[BP_CHURN], ns_per_op(start, num_items * 2));
+
+        old_destroy_hash_map(map);
+    }
+}
+
+static void bench_hash_map(double* results) {
+    for (size_t round = 0; round < num_rounds; round++) {
+        struct HashMap* map = create_hash_map();
+
+        uint64_t start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            to_hash_map(map, key(i), i + 1, false);
+        results[BP_INSERT] = SDL_min(results[BP_INSERT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)from_hash_map(map, key(i));
+        results[BP_HIT] = SDL_min(results[BP_HIT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)from_hash_map(map, key(num_items + i));
+        results[BP_MISS] = SDL_min(results[BP_MISS], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items * 2; i++) {
+            sink += (uintptr_t)pop_hash_map(map, key(i % (num_items * 2)), false);
+            to_hash_map(map, key((i + num_items) % (num_items * 2)), i + 1, false);
+        }
+        results[BP_CHURN] = SDL_min(results[BP_CHURN], ns_per_op(start, num_items * 2));
+
+        destroy_hash_map(map, false);
+    }
+}
+
+static void bench_old_int_map(double* results) {
+    for (size_t round = 0; round < num_rounds; round++) {
+        struct OldIntMap* map = old_create_int_map();
+
+        uint64_t start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            old_to_int_map(map, int_keys[i], (void*)(i + 1));
+        results[BP_INSERT] = SDL_min(results[BP_INSERT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)old_from_int_map(map, int_keys[i]);
+        results[BP_HIT] = SDL_min(results[BP_HIT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)old_from_int_map(map, int_keys[num_items + i]);
+        results[BP_MISS] = SDL_min(results[BP_MISS], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items * 2; i++) {
+            sink += (uintptr_t)old_pop_int_map(map, int_keys[i % (num_items * 2)]);
+            old_to_int_map(map, int_keys[(i + num_items) % (num_items * 2)], (void*)(i + 1));
+        }
+        results[BP_CHURN] = SDL_min(results[BP_CHURN], ns_per_op(start, num_items * 2));
+
+        old_destroy_int_map(map);
+    }
+}
+
+static void bench_int_map(double* results) {
+    for (size_t round = 0; round < num_rounds; round++) {
+        struct IntMap* map = create_int_map();
+
+        uint64_t start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            to_int_map(map, int_keys[i], i + 1, false);
+        results[BP_INSERT] = SDL_min(results[BP_INSERT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)from_int_map(map, int_keys[i]);
+        results[BP_HIT] = SDL_min(results[BP_HIT], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items; i++)
+            sink += (uintptr_t)from_int_map(map, int_keys[num_items + i]);
+        results[BP_MISS] = SDL_min(results[BP_MISS], ns_per_op(start, num_items));
+
+        start = SDL_GetTicksNS();
+        for (size_t i = 0; i < num_items * 2; i++) {
+            sink += (uintptr_t)pop_int_map(map, int_keys[i % (num_items * 2)], false);
+            to_int_map(map, int_keys[(i + num_items) % (num_items * 2)], i + 1, false);
+        }
+        results[BP_CHURN] = SDL_min(results[BP_CHURN], ns_per_op(start, num_items * 2));
+
+        destroy_int_map(map, false);
+    }
+}
+
+static void run(const char* title, void (*old_bench)(double*), void (*new_bench)(double*)) {
+    double old_results[BP_SIZE], new_results[BP_SIZE];
+    for (size_t i = 0; i < BP_SIZE; i++)
+        old_results[i] = new_results[i] = INFINITY;
+    old_bench(old_results);
+    new_bench(new_results);
+
+    SDL_Log("%-16s %10s %10s %9s", title, "old ns/op", "new ns/op", "speedup");
+    for (size_t i = 0; i < BP_SIZE; i++)
+        report(pass_names[i], old_results[i], new_results[i]);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1)
+        num_items = SDL_max(SDL_strtoul(argv[1], NULL, 10), 1);
+    if (argc > 2)
+        num_rounds = SDL_max(SDL_strtoul(argv[2], NULL, 10), 1);
+
+    // Asset-like names and spread out IDs like handles
+    keys = lame_alloc(num_items * 2 * KEY_SIZE);
+    int_keys = lame_alloc(num_items * 2 * sizeof(uint32_t));
+    for (size_t i = 0; i < num_items * 2; i++) {
+        SDL_snprintf(&keys[i * KEY_SIZE], KEY_SIZE, "asset_%zu", i);
+        int_keys[i] = (uint32_t)((i + 1) * 2654435761u);
+    }
+
+    // HashMap interns its keys for good, so intern them all up front and no
+    // round pays for it
+    for (size_t i = 0; i < num_items * 2; i++)
+        intern(key(i));
+
+    SDL_Log("%zu items, best of %zu rounds", num_items, num_rounds);
+    run("HashMap", bench_old_hash_map, bench_hash_map);
+    run("IntMap", bench_old_int_map, bench_int_map);
+
+    lame_free(&keys);
+    lame_free(&int_keys);
+    atom_teardown();
+    return (sink == 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
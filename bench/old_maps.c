@@ -0,0 +1,216 @@
+#include "old_maps.h"
+
+#define HASH_CAPACITY 2
+#define FNV_OFFSET 0x811c9dc5
+#define FNV_PRIME 0x01000193
+
+static uint32_t hash_key(const char* key) {
+    uint32_t hash = FNV_OFFSET;
+    for (const char* p = key; *p; p++) {
+        hash ^= (uint32_t)(unsigned char)(*p);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+struct OldHashMap* old_create_hash_map() {
+    struct OldHashMap* map = lame_alloc_clean(sizeof(struct OldHashMap));
+    map->capacity = HASH_CAPACITY;
+    map->items = lame_alloc_clean(HASH_CAPACITY * sizeof(struct OldKeyValuePair));
+    return map;
+}
+
+void old_destroy_hash_map(struct OldHashMap* map) {
+    lame_free(&map->items);
+    lame_free(&map);
+}
+
+static bool to_hash_map_direct(
+    struct OldKeyValuePair* items, size_t* count, size_t* length, size_t capacity, const char* key, void* value
+) {
+    size_t index = (size_t)hash_key(key) % capacity;
+    struct OldKeyValuePair* kvp = &(items[index]);
+    while (kvp->key != NULL) {
+        if (kvp->key != OLD_HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0) {
+            if (kvp->value != NULL)
+                return false;
+            kvp->value = value;
+            return true;
+        }
+
+        index = (index + 1) % capacity;
+        kvp = &(items[index]);
+    }
+
+    items[index].key = (char*)key;
+    items[index].value = value;
+    if (count != NULL) {
+        (*count)++;
+        (*length)++;
+    }
+    return true;
+}
+
+static void expand_hash_map(struct OldHashMap* map) {
+    const size_t new_capacity = map->capacity * 2;
+    struct OldKeyValuePair* items = lame_alloc_clean(new_capacity * sizeof(struct OldKeyValuePair));
+
+    for (size_t i = 0; i < map->capacity; i++) {
+        struct OldKeyValuePair* kvp = &(map->items[i]);
+        if (kvp->key != NULL) {
+            if (kvp->key == OLD_HASH_TOMBSTONE)
+                map->length--;
+            else
+                to_hash_map_direct(items, NULL, NULL, new_capacity, kvp->key, kvp->value);
+        }
+    }
+
+    lame_free(&(map->items));
+    map->items = items;
+    map->capacity = new_capacity;
+}
+
+bool old_to_hash_map(struct OldHashMap* map, const char* key, void* value) {
+    if (map->length >= map->capacity / 2)
+        expand_hash_map(map);
+    return to_hash_map_direct(map->items, &(map->count), &(map->length), map->capacity, key, value);
+}
+
+void* old_from_hash_map(struct OldHashMap* map, const char* key) {
+    size_t index = (size_t)hash_key(key) % map->capacity;
+    const struct OldKeyValuePair* kvp = &map->items[index];
+    while (kvp->key != NULL) {
+        if (kvp->key != OLD_HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0)
+            return kvp->value;
+
+        index = (index + 1) % map->capacity;
+        kvp = &map->items[index];
+    }
+
+    return NULL;
+}
+
+void* old_pop_hash_map(struct OldHashMap* map, const char* key) {
+    size_t index = (size_t)hash_key(key) % map->capacity;
+    struct OldKeyValuePair* kvp = &map->items[index];
+    while (kvp->key != NULL) {
+        if (kvp->key != OLD_HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0) {
+            kvp->key = OLD_HASH_TOMBSTONE;
+            void* value = kvp->value;
+            kvp->value = NULL;
+            map->count--;
+            return value;
+        }
+
+        index = (index + 1) % map->capacity;
+        kvp = &map->items[index];
+    }
+
+    return NULL;
+}
+
+static uint32_t int_hash_key(uint32_t key) {
+    uint32_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+        hash ^= (uint32_t)(key >> (i << 3)) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+struct OldIntMap* old_create_int_map() {
+    struct OldIntMap* map = lame_alloc_clean(sizeof(struct OldIntMap));
+    map->capacity = HASH_CAPACITY;
+    map->items = lame_alloc_clean(HASH_CAPACITY * sizeof(struct OldIKeyValuePair));
+    return map;
+}
+
+void old_destroy_int_map(struct OldIntMap* map) {
+    lame_free(&map->items);
+    lame_free(&map);
+}
+
+static bool to_int_map_direct(
+    struct OldIKeyValuePair* items, size_t* count, size_t* length, size_t capacity, uint32_t key, void* value
+) {
+    size_t index = (size_t)int_hash_key(key) % capacity;
+    struct OldIKeyValuePair* kvp = &(items[index]);
+    while (kvp->state != OLD_IKVP_NONE) {
+        if (kvp->state != OLD_IKVP_DELETED && key == kvp->key) {
+            if (kvp->value != NULL)
+                return false;
+            kvp->value = value;
+            return true;
+        }
+
+        index = (index + 1) % capacity;
+        kvp = &(items[index]);
+    }
+
+    items[index].state = OLD_IKVP_OCCUPIED;
+    items[index].key = key;
+    items[index].value = value;
+    if (count != NULL) {
+        (*count)++;
+        (*length)++;
+    }
+    return true;
+}
+
+static void expand_int_map(struct OldIntMap* map) {
+    const size_t new_capacity = map->capacity * 2;
+    struct OldIKeyValuePair* items = lame_alloc_clean(new_capacity * sizeof(struct OldIKeyValuePair));
+
+    for (size_t i = 0; i < map->capacity; i++) {
+        struct OldIKeyValuePair* kvp = &(map->items[i]);
+        if (kvp->state != OLD_IKVP_NONE) {
+            if (kvp->state == OLD_IKVP_DELETED)
+                map->length--;
+            else
+                to_int_map_direct(items, NULL, NULL, new_capacity, kvp->key, kvp->value);
+        }
+    }
+
+    lame_free(&(map->items));
+    map->items = items;
+    map->capacity = new_capacity;
+}
+
+bool old_to_int_map(struct OldIntMap* map, uint32_t key, void* value) {
+    if (map->length >= map->capacity / 2)
+        expand_int_map(map);
+    return to_int_map_direct(map->items, &(map->count), &(map->length), map->capacity, key, value);
+}
+
+void* old_from_int_map(struct OldIntMap* map, uint32_t key) {
+    size_t index = (size_t)int_hash_key(key) % map->capacity;
+    const struct OldIKeyValuePair* kvp = &map->items[index];
+    while (kvp->state != OLD_IKVP_NONE) {
+        if (kvp->state != OLD_IKVP_DELETED && key == kvp->key)
+            return kvp->value;
+
+        index = (index + 1) % map->capacity;
+        kvp = &map->items[index];
+    }
+
+    return NULL;
+}
+
+void* old_pop_int_map(struct OldIntMap* map, uint32_t key) {
+    size_t index = (size_t)int_hash_key(key) % map->capacity;
+    struct OldIKeyValuePair* kvp = &map->items[index];
+    while (kvp->state != OLD_IKVP_NONE) {
+        if (kvp->state != OLD_IKVP_DELETED && key == kvp->key) {
+            kvp->state = OLD_IKVP_DELETED;
+            void* value = kvp->value;
+            kvp->value = NULL;
+            map->count--;
+            return value;
+        }
+
+        index = (index + 1) % map->capacity;
+        kvp = &map->items[index];
+    }
+
+    return NULL;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "L_memory.h"
+
+// HashMap and IntMap as they were before the Robin Hood rewrite, kept only so
+// bench_maps can compare against them. Modulo indexing, linear probing and
+// tombstones. The old HashMap duplicated its keys, this one borrows them like
+// the new one borrows atoms, so only the probing is compared.
+
+#define OLD_HASH_TOMBSTONE ((char*)(-1))
+
+struct OldKeyValuePair {
+    char* key;
+    void* value;
+};
+
+struct OldHashMap {
+    struct OldKeyValuePair* items;
+    size_t count, length, capacity;
+};
+
+struct OldHashMap* old_create_hash_map();
+void old_destroy_hash_map(struct OldHashMap*);
+bool old_to_hash_map(struct OldHashMap*, const char*, void*);
+void* old_from_hash_map(struct OldHashMap*, const char*);
+void* old_pop_hash_map(struct OldHashMap*, const char*);
+
+enum OldIKVPState {
+    OLD_IKVP_NONE,
+    OLD_IKVP_OCCUPIED,
+    OLD_IKVP_DELETED,
+};
+
+struct OldIKeyValuePair {
+    enum OldIKVPState state;
+    uint32_t key;
+    void* value;
+};
+
+struct OldIntMap {
+    struct OldIKeyValuePair* items;
+    size_t count, length, capacity;
+};
+
+struct OldIntMap* old_create_int_map();
+void old_destroy_int_map(struct OldIntMap*);
+bool old_to_int_map(struct OldIntMap*, uint32_t, void*);
+void* old_from_int_map(struct OldIntMap*, uint32_t);
+void* old_pop_int_map(struct OldIntMap*, uint32_t);
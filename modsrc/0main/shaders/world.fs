@@ -67,6 +67,8 @@ uniform vec4 u_specular;
 uniform bool u_has_lightmap;
 uniform sampler2D u_lightmap;
 
+uniform bool u_depth_only;
+
 float matdot(float dotp) {
 	dotp = u_half_lambert ? pow((dotp * 0.5) + 0.5, 2.0) : max(dotp, 0.0);
 	return smoothstep(0.0 + u_cel, 1.0 - u_cel, dotp);
@@ -96,6 +98,15 @@ void main() {
         sample.a = 1.0;
     }
 
+    if (u_depth_only) {
+        // Only dither out what the main pass would, skip lighting
+        float fog = clamp((length(v_position) - u_fog_distance.x) / (u_fog_distance.y - u_fog_distance.x), 0.0, 1.0);
+        if (v_color.a * sample.a * mix(1.0, u_fog_color.a, fog) <= (bayer8(gl_FragCoord.xy) + 0.003921568627451))
+            discard;
+        o_color = vec4(1.0);
+        return;
+    }
+
     vec3 reflection = normalize(reflect(v_view_position, v_normal));
     vec4 lighting = u_has_lightmap ? (texture(u_lightmap, v_uv.zw) * 2.0) : u_ambient;
     float specular = 0.0;
@@ -1,13 +1,13 @@
 #version 330 core
 
-#define MAX_BONES 128
-
 layout(location = 0) in vec3 i_position;
 layout(location = 1) in vec3 i_normal;
 layout(location = 2) in vec4 i_color;
 layout(location = 3) in vec4 i_uv;
 layout(location = 4) in vec4 i_bone_index;
 layout(location = 5) in vec4 i_bone_weight;
+layout(location = 6) in mat4 i_instance_matrix;
+layout(location = 10) in vec2 i_instance_frame;
 
 out vec3 v_position;
 out vec3 v_world_position;
@@ -18,6 +18,8 @@ out vec4 v_uv;
 out float v_rimlight;
 
 uniform mat4 u_model_matrix;
+uniform mat4 u_previous_model_matrix;
+uniform float u_previous_weight; // 0 draws the current tick, 1 the previous one
 uniform mat4 u_view_matrix;
 uniform mat4 u_projection_matrix;
 uniform mat4 u_mvp_matrix;
@@ -26,7 +28,13 @@ uniform float u_time;
 uniform vec4 u_wind;
 
 uniform bool u_animated;
-uniform vec4 u_sample[2 * MAX_BONES];
+uniform samplerBuffer u_palette;
+uniform int u_palette_offset;
+uniform int u_previous_palette_offset;
+
+uniform bool u_crowd;
+uniform sampler2D u_crowd_frames;
+uniform float u_crowd_time;
 
 uniform vec2 u_scroll;
 uniform vec3 u_material_wind;
@@ -143,22 +151,63 @@ vec3 dq_transform(vec4 real, vec4 dual, vec3 v) {
 	return (quat_rotate(real, v) + 2.0 * (real.w * d3 - dual.w * r3 + cross(r3, d3)));
 }
 
+// Blend a bone between two baked crowd frames
+void crowd_bone(int bone, ivec2 frames, float blend, out vec4 real, out vec4 dual) {
+	vec4 real_a = texelFetch(u_crowd_frames, ivec2(bone * 2, frames.x), 0);
+	vec4 dual_a = texelFetch(u_crowd_frames, ivec2(bone * 2 + 1, frames.x), 0);
+	vec4 real_b = texelFetch(u_crowd_frames, ivec2(bone * 2, frames.y), 0);
+	vec4 dual_b = texelFetch(u_crowd_frames, ivec2(bone * 2 + 1, frames.y), 0);
+	if (dot(real_a, real_b) < 0.0) {
+		real_b *= -1.0;
+		dual_b *= -1.0;
+	}
+	real = mix(real_a, real_b, blend);
+	dual = mix(dual_a, dual_b, blend);
+}
+
+// Blend a bone between the previous and current tick
+void palette_bone(int bone, out vec4 real, out vec4 dual) {
+	int i = u_palette_offset + bone * 2;
+	real = texelFetch(u_palette, i);
+	dual = texelFetch(u_palette, i + 1);
+	if (u_previous_weight > 0.0) {
+		int j = u_previous_palette_offset + bone * 2;
+		vec4 real_b = texelFetch(u_palette, j);
+		vec4 dual_b = texelFetch(u_palette, j + 1);
+		if (dot(real, real_b) < 0.0) {
+			real_b *= -1.0;
+			dual_b *= -1.0;
+		}
+		real = mix(real, real_b, u_previous_weight);
+		dual = mix(dual, dual_b, u_previous_weight);
+	}
+}
+
 void main() {
+    mat4 model_matrix = u_crowd ? i_instance_matrix : u_model_matrix;
     vec3 position = i_position;
     vec3 normal = i_normal;
-    if (u_animated) {
-        ivec4 i = ivec4(i_bone_index) * 2;
-		ivec4 j = i + 1;
-
-        vec4 real0 = u_sample[i.x];
-		vec4 real1 = u_sample[i.y];
-		vec4 real2 = u_sample[i.z];
-		vec4 real3 = u_sample[i.w];
-
-		vec4 dual0 = u_sample[j.x];
-		vec4 dual1 = u_sample[j.y];
-		vec4 dual2 = u_sample[j.z];
-		vec4 dual3 = u_sample[j.w];
+    if (u_animated || u_crowd) {
+        vec4 real0, real1, real2, real3;
+        vec4 dual0, dual1, dual2, dual3;
+        if (u_crowd) {
+            int num_frames = textureSize(u_crowd_frames, 0).y;
+            float frame = mod(i_instance_frame.x + (i_instance_frame.y * u_crowd_time), float(num_frames));
+            ivec2 frames = ivec2(int(frame), (int(frame) + 1) % num_frames);
+            float blend = fract(frame);
+
+            ivec4 b = ivec4(i_bone_index);
+            crowd_bone(b.x, frames, blend, real0, dual0);
+            crowd_bone(b.y, frames, blend, real1, dual1);
+            crowd_bone(b.z, frames, blend, real2, dual2);
+            crowd_bone(b.w, frames, blend, real3, dual3);
+        } else {
+            ivec4 b = ivec4(i_bone_index);
+            palette_bone(b.x, real0, dual0);
+            palette_bone(b.y, real1, dual1);
+            palette_bone(b.z, real2, dual2);
+            palette_bone(b.w, real3, dual3);
+        }
 
 		if (dot(real0, real1) < 0.0) {
 			real1 *= -1.0;
@@ -183,22 +232,27 @@ void main() {
         normal = quat_rotate(blend_real, normal);
     }
 
-    vec4 world_position = u_model_matrix * vec4(position, 1.0);
+    vec4 world_position = model_matrix * vec4(position, 1.0);
+    vec3 world_normal = mat3(model_matrix) * normal;
+    if (u_previous_weight > 0.0 && !u_crowd) {
+        world_position = mix(world_position, u_previous_model_matrix * vec4(position, 1.0), u_previous_weight);
+        world_normal = mix(world_normal, mat3(u_previous_model_matrix) * normal, u_previous_weight);
+    }
     if (u_material_wind.x > 0.0) {
 		float wind_time = u_time * u_material_wind.y;
 		float wind_weight = (1.0 - (u_material_wind.z * clamp(i_uv.y, 0.0, 1.0))) * u_wind.w * u_material_wind.x;
 
         vec3 v = i_position;
-		world_position.x += u_wind.x * snoise(vec4( v.x, -v.y, -v.z, wind_time)) * wind_weight * min(length(u_model_matrix[0]), 1.0);
-		world_position.y += u_wind.y * snoise(vec4(-v.x,  v.y, -v.z, wind_time)) * wind_weight * min(length(u_model_matrix[1]), 1.0);
-		world_position.z += u_wind.z * snoise(vec4(-v.x, -v.y,  v.z, wind_time)) * wind_weight * min(length(u_model_matrix[2]), 1.0);
+		world_position.x += u_wind.x * snoise(vec4( v.x, -v.y, -v.z, wind_time)) * wind_weight * min(length(model_matrix[0]), 1.0);
+		world_position.y += u_wind.y * snoise(vec4(-v.x,  v.y, -v.z, wind_time)) * wind_weight * min(length(model_matrix[1]), 1.0);
+		world_position.z += u_wind.z * snoise(vec4(-v.x, -v.y,  v.z, wind_time)) * wind_weight * min(length(model_matrix[2]), 1.0);
 	}
 
     gl_Position = u_projection_matrix * u_view_matrix * world_position;
     v_position = gl_Position.xyz;
     v_world_position = world_position.xyz;
     v_view_position = v_world_position + (u_view_matrix[3] * u_view_matrix).xyz;
-    v_normal = normalize(mat3(u_model_matrix) * normal);
+    v_normal = normalize(world_normal);
     v_color = i_color;
     v_uv = i_uv;
     v_uv.xy += u_time * u_scroll;
@@ -4,10 +4,14 @@
 static struct HashMap* actor_types = NULL;
 static struct Actor* actors = NULL;
 static struct Fixture* actor_handles = NULL;
+static struct Pool *actor_pool = NULL, *camera_pool = NULL, *light_pool = NULL;
 
 void actor_init() {
     actor_types = create_hash_map();
     actor_handles = create_fixture();
+    actor_pool = create_pool("actors", sizeof(struct Actor), ACTOR_POOL_SIZE);
+    camera_pool = create_pool("cameras", sizeof(struct ActorCamera), ACTOR_POOL_SIZE);
+    light_pool = create_pool("lights", sizeof(struct ActorLight), MAX_ROOM_LIGHTS);
 
     INFO("Opened");
 }
@@ -16,14 +20,13 @@ void actor_teardown() {
     while (actors != NULL)
         destroy_actor(actors, false, false);
 
-    for (size_t i = 0; actor_types->count > 0 && i < actor_types->capacity; i++) {
+    for (size_t i = 0; i < actor_types->capacity; i++) {
         struct KeyValuePair* kvp = &actor_types->items[i];
-        if (kvp->key == NULL || kvp->key == HASH_TOMBSTONE)
+        if (kvp->key == NULL)
             continue;
 
         struct ActorType* type = kvp->value;
         if (type != NULL) {
-            lame_free(&(type->name));
             unreference(&(type->load));
             unreference(&(type->create));
             unreference(&(type->create_camera));
@@ -36,14 +39,13 @@ void actor_teardown() {
             unreference(&(type->draw_ui));
             lame_free(&(kvp->value));
         }
-
-        lame_free(&kvp->key);
-        kvp->key = HASH_TOMBSTONE;
-        actor_types->count--;
     }
 
     destroy_hash_map(actor_types, false);
     CLOSE_POINTER(actor_handles, destroy_fixture);
+    CLOSE_POINTER(actor_pool, destroy_pool);
+    CLOSE_POINTER(camera_pool, destroy_pool);
+    CLOSE_POINTER(light_pool, destroy_pool);
 
     INFO("Closed");
 }
@@ -65,7 +67,7 @@ int define_actor(lua_State* L) {
     struct ActorType* type = from_hash_map(actor_types, name);
     if (type == NULL) {
         type = lame_alloc_clean(sizeof(struct ActorType));
-        type->name = SDL_strdup(name);
+        type->name = intern(name);
         to_hash_map(actor_types, name, type, true);
     } else {
         WARN("Redefining Actor \"%s\"", name);
@@ -155,6 +157,10 @@ struct ActorType* get_actor_type(const char* name) {
     return (struct ActorType*)from_hash_map(actor_types, name);
 }
 
+struct ActorType* get_actor_type_atom(Atom name) {
+    return (struct ActorType*)from_hash_map_atom(actor_types, name);
+}
+
 struct Actor* get_actors() {
     return actors;
 }
@@ -178,7 +184,7 @@ struct Actor* create_actor_from_type(
     if (base != NULL && ((base->flags & RAF_DISPOSED) || base->actor != NULL))
         return NULL;
 
-    struct Actor* actor = lame_alloc_clean(sizeof(struct Actor));
+    struct Actor* actor = pool_alloc(actor_pool);
     ActorID hid = create_handle(actor_handles, actor);
     actor->hid = hid;
     actor->type = type;
@@ -203,11 +209,15 @@ struct Actor* create_actor_from_type(
     glm_vec3_copy(angle, actor->angle);
     glm_vec3_copy(actor->pos, actor->draw_pos[0]);
     glm_vec3_copy(actor->angle, actor->draw_angle[0]);
+    glm_vec3_copy(actor->pos, actor->draw_pos[1]);
+    glm_vec3_copy(actor->angle, actor->draw_angle[1]);
 
     glm_vec3_one(actor->friction);
 
     actor->table = create_table_ref();
     actor->flags = AF_DEFAULT;
+    if (base != NULL && (base->flags & RAF_STATIC))
+        actor->flags |= AF_STATIC;
     actor->userdata = create_pointer_ref("actor", actor);
     actor->tag = tag;
     if (base != NULL && base->special != LUA_NOREF)
@@ -231,7 +241,7 @@ struct ActorCamera* create_actor_camera(struct Actor* actor) {
     if (actor->camera != NULL)
         return actor->camera;
 
-    struct ActorCamera* camera = lame_alloc_clean(sizeof(struct ActorCamera));
+    struct ActorCamera* camera = pool_alloc(camera_pool);
     camera->actor = actor;
 
     glm_vec3_copy(actor->pos, camera->pos);
@@ -242,6 +252,10 @@ struct ActorCamera* create_actor_camera(struct Actor* actor) {
     glm_vec3_copy(actor->angle, camera->draw_angle[0]);
     camera->draw_fov[0] = camera->fov;
     camera->draw_range[0] = camera->range;
+    glm_vec3_copy(actor->pos, camera->draw_pos[1]);
+    glm_vec3_copy(actor->angle, camera->draw_angle[1]);
+    camera->draw_fov[1] = camera->fov;
+    camera->draw_range[1] = camera->range;
 
     camera->userdata = create_pointer_ref("camera", camera);
     camera->table = create_table_ref();
@@ -268,7 +282,7 @@ struct ActorLight* create_actor_light(struct Actor* actor) {
     size_t i = 0;
     for (; i < MAX_ROOM_LIGHTS; i++)
         if (room->light_occupied[i] == NULL) {
-            light = lame_alloc_clean(sizeof(struct ActorLight));
+            light = pool_alloc(light_pool);
             room->light_occupied[i] = light;
             break;
         }
@@ -290,11 +304,16 @@ struct ModelInstance* create_actor_model(struct Actor* actor, struct Model* mode
     if (actor->model != NULL)
         return actor->model;
 
+    if (actor->flags & AF_STATIC)
+        batch_model(model);
+
     struct ModelInstance* inst = create_model_instance(model);
     glm_vec3_copy(actor->pos, inst->pos);
     glm_vec3_copy(actor->angle, inst->angle);
     glm_vec3_copy(actor->draw_pos[0], inst->draw_pos[0]);
     glm_vec3_copy(actor->draw_angle[0], inst->draw_angle[0]);
+    glm_vec3_copy(actor->draw_pos[1], inst->draw_pos[1]);
+    glm_vec3_copy(actor->draw_angle[1], inst->draw_angle[1]);
 
     return (actor->model = inst);
 }
@@ -386,7 +405,7 @@ void destroy_actor(struct Actor* actor, bool natural, bool dispose) {
         destroy_emitter(actor->emitter);
 
     destroy_handle(actor_handles, actor->hid);
-    lame_free(&actor);
+    pool_free(actor_pool, &actor);
 }
 
 void destroy_actor_camera(struct Actor* actor) {
@@ -408,7 +427,7 @@ void destroy_actor_camera(struct Actor* actor) {
         dispose_surface(camera->surface);
     unreference(&(camera->surface_ref));
 
-    lame_free(&(actor->camera));
+    pool_free(camera_pool, &(actor->camera));
 }
 
 void destroy_actor_light(struct Actor* actor) {
@@ -418,7 +437,7 @@ void destroy_actor_light(struct Actor* actor) {
     light->light->active = RL_OFF;
     actor->room->light_occupied[light->slot] = NULL;
     unreference_pointer(&(light->userdata));
-    lame_free(&(actor->light));
+    pool_free(light_pool, &(actor->light));
 }
 
 void destroy_actor_model(struct Actor* actor) {
@@ -430,9 +449,15 @@ struct Actor* hid_to_actor(ActorID hid) {
 }
 
 bool actor_is_ancestor(struct Actor* actor, const char* name) {
+    // Type names are atoms, so a name that was never interned can't belong to any type
+    Atom atom = find_atom(name);
+    return atom != NULL && actor_is_ancestor_atom(actor, atom);
+}
+
+bool actor_is_ancestor_atom(struct Actor* actor, Atom name) {
     struct ActorType* it = actor->type;
     while (it != NULL) {
-        if (SDL_strcmp(it->name, name) == 0)
+        if (it->name == name)
             return true;
         it = it->parent;
     }
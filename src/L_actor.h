@@ -8,6 +8,8 @@
 #include "L_script.h" // IWYU pragma: keep
 #include "L_video.h"
 
+#define ACTOR_POOL_SIZE 256 // Actors and cameras per pool slab
+
 typedef HandleID ActorID;
 
 enum ActorFlags {
@@ -43,6 +45,9 @@ enum ActorFlags {
     AF_PUSHABLE = 1 << 18,  // [INTERNAL] Pushed by other actors with greater or equal mass.
     AF_HITSCAN = 1 << 19,   // Intercepts hitscans.
 
+    // Visual
+    AF_STATIC = 1 << 20, // Model gets its submodels batched by material.
+
     AF_DEFAULT = AF_VISIBLE,
 };
 
@@ -59,7 +64,7 @@ enum CameraFlags {
 };
 
 struct ActorType {
-    const char* name;
+    Atom name;
     struct ActorType* parent;
 
     int load;
@@ -142,6 +147,7 @@ void actor_teardown();
 int define_actor(lua_State*);
 bool load_actor(const char*);
 struct ActorType* get_actor_type(const char*);
+struct ActorType* get_actor_type_atom(Atom);
 struct Actor* get_actors();
 
 struct Actor* create_actor(struct Room*, struct RoomActor*, const char*, bool, vec3, vec3, uint16_t);
@@ -160,5 +166,6 @@ void destroy_actor_model(struct Actor*);
 
 struct Actor* hid_to_actor(ActorID);
 bool actor_is_ancestor(struct Actor*, const char*);
+bool actor_is_ancestor_atom(struct Actor*, Atom);
 
 void set_actor_pos(struct Actor*, vec3);
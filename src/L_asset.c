@@ -1,3 +1,5 @@
+#include <SDL3/SDL_mutex.h>
+#include <SDL3/SDL_thread.h>
 #include <SDL3_image/SDL_image.h>
 
 #include "L_asset.h"
@@ -25,6 +27,7 @@ void load_shader(const char* name) {
         return;
     }
 
+    video_sync(); // See load_model()
     GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
 
     GLchar* code = SDL_LoadFile(file, NULL);
@@ -80,6 +83,8 @@ void load_shader(const char* name) {
     glBindAttribLocation(shader->program, VATT_UV, "i_uv");
     glBindAttribLocation(shader->program, VATT_BONE_INDEX, "i_bone_index");
     glBindAttribLocation(shader->program, VATT_BONE_WEIGHT, "i_bone_weight");
+    glBindAttribLocation(shader->program, VATT_INSTANCE_MATRIX, "i_instance_matrix");
+    glBindAttribLocation(shader->program, VATT_INSTANCE_FRAME, "i_instance_frame");
     glLinkProgram(shader->program);
 
     glGetProgramiv(shader->program, GL_LINK_STATUS, &success);
@@ -94,16 +99,15 @@ void load_shader(const char* name) {
     glDeleteShader(fragment);
 
     // Uniforms
-    shader->uniforms = SDL_CreateProperties();
-    if (shader->uniforms == 0)
-        FATAL("Shader \"%s\" uniforms fail: %s", name, SDL_GetError());
+    shader->uniforms = create_hash_map();
     GLsizei unum;
     glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &unum);
     for (GLsizei i = 0; i < unum; i++) {
         GLchar uname[256];
         glGetActiveUniform(shader->program, i, 256, NULL, NULL, NULL, uname);
-        if (!SDL_SetNumberProperty(shader->uniforms, uname, (Sint64)glGetUniformLocation(shader->program, uname)))
-            FATAL("Shader \"%s\" uniform \"%s\" fail: %s", name, uname, SDL_GetError());
+        const GLint location = glGetUniformLocation(shader->program, uname);
+        if (location >= 0)
+            to_hash_map(shader->uniforms, uname, (void*)((intptr_t)location + 1), false);
     }
 
     shader->userdata = create_pointer_ref("shader", shader);
@@ -116,7 +120,7 @@ void destroy_shader(struct Shader* shader) {
     unreference_pointer(&(shader->userdata));
 
     glDeleteProgram(shader->program);
-    SDL_DestroyProperties(shader->uniforms);
+    destroy_hash_map(shader->uniforms, false);
 
     DEBUG("Freed shader \"%s\" (%u)", shader->name, shader);
     lame_free(&(shader->name));
@@ -126,82 +130,761 @@ void destroy_shader(struct Shader* shader) {
 // Textures
 SOURCE_ASSET(textures, texture, struct Texture*);
 
-void load_texture(const char* name) {
-    if (get_texture(name) != NULL)
-        return;
+struct TextureJob {
+    struct TextureJob* next;
+    struct Texture* texture; // NULL if the texture was destroyed while loading
+    char* name;
+    char file[FILE_PATH_MAX], cache_path[FILE_PATH_MAX];
+    bool compress, cooked, cached; // Cooked data was read from the cache, cached data is in the cache
+    bool stream;                   // Only reload levels "lod" and below from the cache
+    uint32_t lod;
+
+    // Decoded levels, all owned by "buffer"
+    uint8_t* buffer;
+    GLenum format;
+    uint16_t size[2];
+    uint32_t num_levels;
+    uint8_t* levels[TEXTURE_MAX_LEVELS];
+    uint32_t level_sizes[TEXTURE_MAX_LEVELS];
+
+    // Upload, then readback of the driver's compressed levels into "pack"
+    GLuint id, pack;
+    GLsync fence;
+    size_t pbo;
+};
+
+struct TexturePBO {
+    GLuint buffer;
+    size_t capacity;
+    bool busy;
+};
+
+static bool texture_compression = false;
+static size_t texture_budget = 0, texture_vram = 0;
+static uint64_t texture_frame = 0;
+static size_t texture_streams = 0; // Stream jobs in flight
+
+static SDL_Thread* texture_thread = NULL;
+static SDL_Mutex* texture_mutex = NULL;
+static SDL_Condition *texture_queued = NULL, *texture_decoded = NULL;
+static bool texture_quit = false;
+static size_t texture_jobs = 0; // Queued or decoding
+
+static struct TextureJob *texture_queue = NULL, *texture_queue_tail = NULL;
+static struct TextureJob *texture_ready = NULL, *texture_ready_tail = NULL;
+static struct TextureJob* texture_uploads = NULL; // Main thread only
+
+static struct TexturePBO texture_pbos[TEXTURE_PBO_RING] = {0};
+
+void set_texture_compression(bool enabled) {
+    texture_compression = enabled;
+}
 
-    SDL_snprintf(asset_file_helper, sizeof(asset_file_helper), "textures/%s.*", name);
-    const char* file = get_mod_file(asset_file_helper, ".json");
-    if (file == NULL) {
-        WARN("Texture \"%s\" not found", name);
-        return;
+void set_texture_budget(size_t budget) {
+    texture_budget = budget;
+}
+
+// Pixel type and size of the uncompressed formats textures can end up in
+static GLenum texture_pixel_type(GLenum format) {
+    switch (format) {
+        default:
+            return GL_UNSIGNED_BYTE;
+        case GL_RGBA16:
+            return GL_UNSIGNED_SHORT;
+        case GL_RGBA16F:
+            return GL_HALF_FLOAT;
+        case GL_RGBA32F:
+            return GL_FLOAT;
     }
+}
 
-    SDL_Surface* surface = IMG_Load(file);
-    if (surface == NULL) {
-        WTF("Texture \"%s\" image fail: %s", name, SDL_GetError());
-        return;
+static size_t texture_pixel_size(GLenum format) {
+    switch (format) {
+        default:
+            return 4;
+        case GL_RGBA16:
+        case GL_RGBA16F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
     }
+}
 
-    // Texture struct
-    struct Texture* texture = lame_alloc_clean(sizeof(struct Texture));
+// VRAM taken by levels "lod" and below
+static size_t texture_level_bytes(GLenum format, const uint16_t size[2], uint32_t num_levels, uint32_t lod) {
+    size_t bytes = 0;
+    for (uint32_t i = lod; i < num_levels; i++) {
+        const size_t width = SDL_max(size[0] >> i, 1), height = SDL_max(size[1] >> i, 1);
+        if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            bytes += ((width + 3) / 4) * ((height + 3) / 4) * 16;
+        else
+            bytes += width * height * texture_pixel_size(format);
+    }
+    return bytes;
+}
 
-    // General
-    texture->name = SDL_strdup(name);
+// Lowest level that a texture is streamed in at
+static uint32_t base_texture_lod(const uint16_t size[2], uint32_t num_levels) {
+    uint32_t lod = 0;
+    while (lod + 1 < num_levels && SDL_max(size[0], size[1]) >> lod > TEXTURE_STREAM_BASE_SIZE)
+        lod++;
+    return lod;
+}
 
-    // Data
-    texture->size[0] = surface->w;
-    texture->size[1] = surface->h;
-    texture->uvs[2] = texture->uvs[3] = 1;
+static void push_texture_job(struct TextureJob** head, struct TextureJob** tail, struct TextureJob* job) {
+    job->next = NULL;
+    if (*tail == NULL)
+        *head = job;
+    else
+        (*tail)->next = job;
+    *tail = job;
+}
 
-    glGenTextures(1, &texture->texture);
-    glBindTexture(GL_TEXTURE_2D, texture->texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-
-    GLint format;
-    switch (surface->format) {
-        default: {
-            SDL_Surface* temp = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGBA32);
-            if (temp == NULL)
-                FATAL("Texture \"%s\" image conversion fail: %s", SDL_GetError());
-            SDL_DestroySurface(surface);
-            surface = temp;
-
-            format = GL_RGBA8;
-            break;
+static struct TextureJob* pop_texture_job(struct TextureJob** head, struct TextureJob** tail) {
+    struct TextureJob* job = *head;
+    if (job != NULL) {
+        *head = job->next;
+        if (*head == NULL)
+            *tail = NULL;
+        job->next = NULL;
+    }
+    return job;
+}
+
+static void free_texture_job(struct TextureJob* job) {
+    if (job->fence != NULL)
+        glDeleteSync(job->fence);
+    if (job->pack != 0) {
+        untrack_buffer(job->pack);
+        glDeleteBuffers(1, &(job->pack));
+    }
+    if (job->buffer != NULL)
+        lame_free(&(job->buffer));
+    lame_free(&(job->name));
+    lame_free(&job);
+}
+
+static bool read_cooked_texture(struct TextureJob* job, uint8_t* buffer, size_t size) {
+    if (size < TEXTURE_CACHE_HEADER)
+        return false;
+
+    struct BinaryReader reader = binary_reader(buffer, size);
+    if (read_u32(&reader) != TEXTURE_CACHE_MAGIC || read_u32(&reader) != TEXTURE_CACHE_VERSION)
+        return false;
+    const uint32_t width = read_u32(&reader);
+    const uint32_t height = read_u32(&reader);
+    const GLenum format = (GLenum)read_u32(&reader);
+    const uint32_t levels = read_u32(&reader);
+    if (width <= 0 || width > UINT16_MAX || height <= 0 || height > UINT16_MAX)
+        return false;
+    if (format != GL_RGBA8 && format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        return false;
+    if (levels <= 0 || levels > TEXTURE_MAX_LEVELS)
+        return false;
+
+    for (uint32_t i = 0; i < levels; i++) {
+        const uint32_t level_size = read_u32(&reader);
+        if (level_size <= 0 || reader_remaining(&reader) < level_size)
+            return false;
+        job->levels[i] = reader.ptr;
+        job->level_sizes[i] = level_size;
+        skip_bytes(&reader, level_size);
+    }
+
+    job->buffer = buffer;
+    job->format = format;
+    job->size[0] = (uint16_t)width;
+    job->size[1] = (uint16_t)height;
+    job->num_levels = levels;
+    job->cooked = job->cached = true;
+    return true;
+}
+
+static bool write_cooked_texture(struct TextureJob* job) {
+    SDL_IOStream* io = SDL_IOFromFile(job->cache_path, "wb");
+    if (io == NULL) {
+        WARN("Can't cook texture \"%s\": %s", job->name, SDL_GetError());
+        return false;
+    }
+
+    bool success = SDL_WriteU32LE(io, TEXTURE_CACHE_MAGIC) && SDL_WriteU32LE(io, TEXTURE_CACHE_VERSION) &&
+                   SDL_WriteU32LE(io, job->size[0]) && SDL_WriteU32LE(io, job->size[1]) &&
+                   SDL_WriteU32LE(io, job->format) && SDL_WriteU32LE(io, job->num_levels);
+    for (uint32_t i = 0; success && i < job->num_levels; i++)
+        success = SDL_WriteU32LE(io, job->level_sizes[i]) &&
+                  SDL_WriteIO(io, job->levels[i], job->level_sizes[i]) == job->level_sizes[i];
+
+    if (!SDL_CloseIO(io) || !success) {
+        WARN("Can't cook texture \"%s\": %s", job->name, SDL_GetError());
+        SDL_RemovePath(job->cache_path);
+        return false;
+    }
+
+    return true;
+}
+
+// Box filter a level down to the next one
+static void downsample_rgba8(
+    const uint8_t* src, int width, int height, uint8_t* dest, int dest_width, int dest_height
+) {
+    for (int y = 0; y < dest_height; y++) {
+        const int y0 = SDL_min(y * 2, height - 1), y1 = SDL_min((y * 2) + 1, height - 1);
+        for (int x = 0; x < dest_width; x++) {
+            const int x0 = SDL_min(x * 2, width - 1), x1 = SDL_min((x * 2) + 1, width - 1);
+            const uint8_t* a = &src[((y0 * width) + x0) * 4];
+            const uint8_t* b = &src[((y0 * width) + x1) * 4];
+            const uint8_t* c = &src[((y1 * width) + x0) * 4];
+            const uint8_t* d = &src[((y1 * width) + x1) * 4];
+            uint8_t* out = &dest[((y * dest_width) + x) * 4];
+            for (int i = 0; i < 4; i++)
+                out[i] = (uint8_t)((a[i] + b[i] + c[i] + d[i] + 2) / 4);
         }
+    }
+}
 
-        case SDL_PIXELFORMAT_RGB24:
-            format = GL_RGB8;
-            break;
+// 16-bit and float sources that RGBA8 would crush. These are kept at their
+// precision as a single level, and skip the cache and compression.
+static GLenum wide_texture_format(SDL_PixelFormat format, SDL_PixelFormat* convert) {
+    switch (format) {
+        default:
+            return GL_NONE;
         case SDL_PIXELFORMAT_RGB48:
-            format = GL_RGB16;
-            break;
+        case SDL_PIXELFORMAT_RGBA64:
+            *convert = SDL_PIXELFORMAT_RGBA64;
+            return GL_RGBA16;
         case SDL_PIXELFORMAT_RGB48_FLOAT:
-            format = GL_RGB16F;
-            break;
+        case SDL_PIXELFORMAT_RGBA64_FLOAT:
+            *convert = SDL_PIXELFORMAT_RGBA64_FLOAT;
+            return GL_RGBA16F;
         case SDL_PIXELFORMAT_RGB96_FLOAT:
-            format = GL_RGB32F;
-            break;
+        case SDL_PIXELFORMAT_RGBA128_FLOAT:
+            *convert = SDL_PIXELFORMAT_RGBA128_FLOAT;
+            return GL_RGBA32F;
+    }
+}
+
+// Generate an RGBA8 mip chain, or a single wide level. Compression is left to
+// the driver on upload.
+static bool build_texture_levels(struct TextureJob* job, SDL_Surface* surface) {
+    SDL_PixelFormat pixel_format = SDL_PIXELFORMAT_RGBA32;
+    const GLenum wide = wide_texture_format(surface->format, &pixel_format);
+    SDL_Surface* rgba = SDL_ConvertSurface(surface, pixel_format);
+    if (rgba == NULL) {
+        WTF("Texture \"%s\" image conversion fail: %s", job->name, SDL_GetError());
+        return false;
+    }
+    if (rgba->w <= 0 || rgba->w > UINT16_MAX || rgba->h <= 0 || rgba->h > UINT16_MAX) {
+        WTF("Texture \"%s\" has invalid size %dx%d", job->name, rgba->w, rgba->h);
+        SDL_DestroySurface(rgba);
+        return false;
+    }
 
-        case SDL_PIXELFORMAT_RGBA32:
-            format = GL_RGBA8;
+    int width = rgba->w, height = rgba->h;
+    if (wide != GL_NONE)
+        job->format = wide;
+    else
+        job->format = job->compress ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+    const size_t pixel_size = SDL_BYTESPERPIXEL(pixel_format);
+    job->size[0] = (uint16_t)width;
+    job->size[1] = (uint16_t)height;
+
+    size_t total = 0;
+    job->num_levels = 0;
+    while (job->num_levels < TEXTURE_MAX_LEVELS) {
+        const int w = SDL_max(width >> job->num_levels, 1), h = SDL_max(height >> job->num_levels, 1);
+        job->level_sizes[job->num_levels++] = (uint32_t)((size_t)w * (size_t)h * pixel_size);
+        total += (size_t)w * (size_t)h * pixel_size;
+        if ((w == 1 && h == 1) || wide != GL_NONE)
             break;
-        case SDL_PIXELFORMAT_RGBA64:
-            format = GL_RGBA16;
+    }
+
+    job->buffer = lame_alloc(total);
+    uint8_t* level = job->buffer;
+    for (uint32_t i = 0; i < job->num_levels; i++) {
+        job->levels[i] = level;
+        level += job->level_sizes[i];
+    }
+
+    // Tightly packed level 0
+    const size_t row = (size_t)width * pixel_size;
+    for (int y = 0; y < height; y++)
+        lame_copy(&job->levels[0][(size_t)y * row], (uint8_t*)rgba->pixels + ((size_t)y * rgba->pitch), row);
+    SDL_DestroySurface(rgba);
+
+    for (uint32_t i = 1; i < job->num_levels; i++) {
+        const int next_width = SDL_max(width / 2, 1), next_height = SDL_max(height / 2, 1);
+        downsample_rgba8(job->levels[i - 1], width, height, job->levels[i], next_width, next_height);
+        width = next_width;
+        height = next_height;
+    }
+
+    return true;
+}
+
+// Runs on the loader thread, must not touch GL or "job->texture"
+static void decode_texture(struct TextureJob* job) {
+    if (job->stream) {
+        size_t cooked_size;
+        uint8_t* cooked = SDL_LoadFile(job->cache_path, &cooked_size);
+        if (cooked != NULL && !read_cooked_texture(job, cooked, cooked_size))
+            lame_free(&cooked);
+        if (job->buffer == NULL)
+            WARN("Can't stream texture \"%s\" from \"%s\"", job->name, job->cache_path);
+        return;
+    }
+
+    size_t source_size;
+    void* source = SDL_LoadFile(job->file, &source_size);
+    if (source == NULL) {
+        WTF("Texture \"%s\" load fail: %s", job->name, SDL_GetError());
+        return;
+    }
+
+    // Cooked textures are keyed by their source's contents
+    char cache_dir[FILE_PATH_MAX];
+    SDL_strlcpy(cache_dir, job->cache_path, sizeof(cache_dir));
+    SDL_snprintf(
+        job->cache_path, sizeof(job->cache_path), "%s%08" SDL_PRIx32 "%08zx%s.ltex", cache_dir,
+        SDL_crc32(0, source, source_size), source_size, job->compress ? "c" : ""
+    );
+
+    size_t cooked_size;
+    uint8_t* cooked = SDL_LoadFile(job->cache_path, &cooked_size);
+    if (cooked != NULL) {
+        if (read_cooked_texture(job, cooked, cooked_size)) {
+            lame_free(&source);
+            return;
+        }
+
+        WARN("Discarding invalid cooked texture \"%s\"", job->cache_path);
+        lame_free(&cooked);
+    }
+
+    SDL_Surface* surface = IMG_Load_IO(SDL_IOFromConstMem(source, source_size), true);
+    lame_free(&source);
+    if (surface == NULL) {
+        WTF("Texture \"%s\" image fail: %s", job->name, SDL_GetError());
+        return;
+    }
+
+    const bool success = build_texture_levels(job, surface);
+    SDL_DestroySurface(surface);
+
+    // Compressed levels only exist after the driver has seen them
+    if (success && job->format == GL_RGBA8)
+        job->cached = write_cooked_texture(job);
+}
+
+static int texture_loop(void* data) {
+    SDL_LockMutex(texture_mutex);
+    while (true) {
+        while (texture_queue == NULL && !texture_quit)
+            SDL_WaitCondition(texture_queued, texture_mutex);
+        if (texture_quit)
             break;
-        case SDL_PIXELFORMAT_RGBA64_FLOAT:
-            format = GL_RGBA16F;
+
+        struct TextureJob* job = pop_texture_job(&texture_queue, &texture_queue_tail);
+        SDL_UnlockMutex(texture_mutex);
+        decode_texture(job);
+        SDL_LockMutex(texture_mutex);
+
+        push_texture_job(&texture_ready, &texture_ready_tail, job);
+        texture_jobs--;
+        SDL_SignalCondition(texture_decoded);
+    }
+    SDL_UnlockMutex(texture_mutex);
+
+    return 0;
+}
+
+static size_t upload_texture_job(struct TextureJob* job, size_t slot) {
+    struct TexturePBO* pbo = &texture_pbos[slot];
+
+    job->lod = SDL_min(job->lod, job->num_levels - 1);
+    size_t total = 0;
+    for (uint32_t i = job->lod; i < job->num_levels; i++)
+        total += job->level_sizes[i];
+
+    // Stage every level in the PBO, fall back to client memory if mapping fails
+    if (pbo->buffer == 0)
+        glGenBuffers(1, &pbo->buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo->buffer);
+    if (total > pbo->capacity) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)total, NULL, GL_STREAM_DRAW);
+        pbo->capacity = total;
+        track_buffer(pbo->buffer, GMT_STAGING, "texture uploads", total);
+    }
+
+    uint8_t* dest =
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dest != NULL) {
+        size_t offset = 0;
+        for (uint32_t i = job->lod; i < job->num_levels; i++) {
+            lame_copy(dest + offset, job->levels[i], job->level_sizes[i]);
+            offset += job->level_sizes[i];
+        }
+        if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            dest = NULL;
+    }
+    if (dest == NULL)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenTextures(1, &job->id);
+    bind_texture(0, GL_TEXTURE_2D, job->id);
+    track_texture(
+        job->id, GMT_TEXTURE, job->name, texture_level_bytes(job->format, job->size, job->num_levels, job->lod)
+    );
+
+    // The top resident level becomes level 0
+    const GLsizei levels = (GLsizei)(job->num_levels - job->lod);
+    GLsizei width = SDL_max(job->size[0] >> job->lod, 1), height = SDL_max(job->size[1] >> job->lod, 1);
+    // Let the driver compress uncooked levels through glTexImage2D
+    const bool compressed = job->cooked && job->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    const bool immutable =
+        GLAD_GL_ARB_texture_storage && (compressed || job->format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+    const GLenum type = texture_pixel_type(job->format);
+    if (immutable)
+        glTexStorage2D(GL_TEXTURE_2D, levels, job->format, width, height);
+    else
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    size_t offset = 0;
+    for (GLint i = 0; i < levels; i++) {
+        const uint32_t level = job->lod + (uint32_t)i;
+        const void* pixels = (dest != NULL) ? (const void*)(uintptr_t)offset : job->levels[level];
+        const GLsizei size = (GLsizei)job->level_sizes[level];
+        if (immutable && compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, job->format, size, pixels);
+        else if (immutable)
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, GL_RGBA, type, pixels);
+        else if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, job->format, width, height, 0, size, pixels);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, (GLint)job->format, width, height, 0, GL_RGBA, type, pixels);
+
+        offset += job->level_sizes[level];
+        width = SDL_max(width / 2, 1);
+        height = SDL_max(height / 2, 1);
+    }
+
+    if (dest != NULL)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    job->pbo = slot;
+    pbo->busy = true;
+
+    return total;
+}
+
+// Start reading the driver's compressed levels back so the encode only
+// happens once. The copy goes into a pack buffer and is picked up when the
+// new fence lands, so nothing waits on it.
+static bool read_compressed_texture(struct TextureJob* job) {
+    bind_texture(0, GL_TEXTURE_2D, job->id);
+
+    GLint is_compressed = GL_FALSE;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &is_compressed);
+    if (!is_compressed)
+        return false;
+
+    size_t total = 0;
+    for (uint32_t i = 0; i < job->num_levels; i++) {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint)i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        if (size <= 0)
+            return false;
+        job->level_sizes[i] = (uint32_t)size;
+        total += (size_t)size;
+    }
+
+    glGenBuffers(1, &(job->pack));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, job->pack);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)total, NULL, GL_STREAM_READ);
+    track_buffer(job->pack, GMT_STAGING, job->name, total);
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < job->num_levels; i++) {
+        glGetCompressedTexImage(GL_TEXTURE_2D, (GLint)i, (void*)(uintptr_t)offset);
+        offset += job->level_sizes[i];
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glDeleteSync(job->fence);
+    job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return true;
+}
+
+static void cook_compressed_texture(struct TextureJob* job) {
+    size_t total = 0;
+    for (uint32_t i = 0; i < job->num_levels; i++)
+        total += job->level_sizes[i];
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, job->pack);
+    const uint8_t* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)total, GL_MAP_READ_BIT);
+    if (src != NULL) {
+        lame_free(&(job->buffer));
+        job->buffer = lame_alloc(total);
+        lame_copy(job->buffer, src, total);
+        const bool mapped = glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+        uint8_t* level = job->buffer;
+        for (uint32_t i = 0; i < job->num_levels; i++) {
+            job->levels[i] = level;
+            level += job->level_sizes[i];
+        }
+        if (mapped)
+            job->cached = write_cooked_texture(job);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Returns false if the job is still waiting on a readback
+static bool finish_texture_job(struct TextureJob* job) {
+    struct Texture* texture = job->texture;
+    if (job->pack != 0) {
+        // The texture was swapped in before the readback, only the cache is left
+        if (texture != NULL) {
+            cook_compressed_texture(job);
+            if (job->cached && texture->cache_path == NULL)
+                texture->cache_path = SDL_strdup(job->cache_path);
+            texture->job = NULL;
+        }
+        free_texture_job(job);
+        return true;
+    }
+
+    texture_pbos[job->pbo].busy = false;
+
+    if (job->stream)
+        texture_streams--;
+
+    if (texture == NULL) {
+        untrack_texture(job->id);
+        glDeleteTextures(1, &(job->id));
+        invalidate_gl_state();
+    } else {
+        // Swap out the old levels, if any
+        if (texture->texture != 0) {
+            untrack_texture(texture->texture);
+            glDeleteTextures(1, &(texture->texture));
+            invalidate_gl_state();
+        }
+        texture->texture = job->id;
+        texture->format = job->format;
+        texture->num_levels = (uint8_t)job->num_levels;
+        texture->lod = (uint8_t)job->lod;
+
+        texture_vram -= texture->vram;
+        texture->vram = texture_level_bytes(job->format, job->size, job->num_levels, job->lod);
+        texture_vram += texture->vram;
+
+        if (!job->cooked && job->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT && read_compressed_texture(job))
+            return false;
+
+        if (job->cached && texture->cache_path == NULL)
+            texture->cache_path = SDL_strdup(job->cache_path);
+        texture->job = NULL;
+    }
+
+    free_texture_job(job);
+    return true;
+}
+
+static void queue_texture_job(struct TextureJob* job) {
+    SDL_LockMutex(texture_mutex);
+    push_texture_job(&texture_queue, &texture_queue_tail, job);
+    texture_jobs++;
+    SDL_SignalCondition(texture_queued);
+    SDL_UnlockMutex(texture_mutex);
+}
+
+static void stream_texture(struct Texture* texture, uint32_t lod) {
+    struct TextureJob* job = lame_alloc_clean(sizeof(struct TextureJob));
+    job->texture = texture;
+    job->name = SDL_strdup(texture->name);
+    SDL_strlcpy(job->cache_path, texture->cache_path, sizeof(job->cache_path));
+    job->stream = true;
+    job->lod = lod;
+
+    texture->job = job;
+    texture_streams++;
+    queue_texture_job(job);
+}
+
+static bool texture_fits(const struct Texture* texture, uint32_t lod) {
+    if (texture_budget <= 0)
+        return true;
+    const size_t bytes = texture_level_bytes(texture->format, texture->size, texture->num_levels, lod);
+    return texture_vram - texture->vram + bytes <= texture_budget;
+}
+
+// Stream in levels requested last frame, and evict the least recently used
+// ones when over budget
+static void stream_textures() {
+    struct Texture* evict = NULL;
+    uint32_t evict_lod = 0;
+    bool blocked = false;
+    for (size_t i = 0; textures->count > 0 && i < textures->capacity; i++) {
+        struct KeyValuePair* kvp = &(textures->items[i]);
+        if (kvp->key == NULL)
+            continue;
+
+        struct Texture* texture = kvp->value;
+        if (texture->job != NULL || texture->texture == 0 || texture->cache_path == NULL)
+            continue;
+
+        const bool used = texture_frame - texture->stream_frame < TEXTURE_STREAM_LINGER;
+        if (used && texture->wanted_lod < texture->lod) {
+            if (texture_streams >= TEXTURE_STREAM_JOBS)
+                continue;
+
+            uint32_t lod = texture->wanted_lod;
+            while (lod < texture->lod && !texture_fits(texture, lod))
+                lod++;
+            if (lod < texture->lod)
+                stream_texture(texture, lod);
+            else
+                blocked = true;
+        } else if (!texture->resident) {
+            // Drop anything sharper than it needs to be, but not past its base level
+            const uint32_t base = base_texture_lod(texture->size, texture->num_levels);
+            const uint32_t target = used ? SDL_min(texture->wanted_lod, base) : base;
+            if (texture->lod < target && (evict == NULL || texture->stream_frame < evict->stream_frame)) {
+                evict = texture;
+                evict_lod = target;
+            }
+        }
+    }
+
+    if (evict != NULL && texture_budget > 0 && (blocked || texture_vram > texture_budget))
+        stream_texture(evict, evict_lod);
+}
+
+void request_texture(struct Texture* texture, float distance) {
+    // Every doubling of distance past the threshold drops a level
+    uint8_t lod = 0;
+    float range = TEXTURE_STREAM_DISTANCE;
+    while (distance > range && lod < TEXTURE_MAX_LEVELS) {
+        range *= 2;
+        lod++;
+    }
+
+    if (texture->stream_frame != texture_frame) {
+        texture->stream_frame = texture_frame;
+        texture->wanted_lod = lod;
+    } else {
+        texture->wanted_lod = SDL_min(texture->wanted_lod, lod);
+    }
+}
+
+void update_textures(bool wait) {
+    if (!wait) {
+        stream_textures();
+        texture_frame++;
+    }
+
+    // Swap in textures whose uploads have landed
+    struct TextureJob** it = &texture_uploads;
+    while (*it != NULL) {
+        struct TextureJob* job = *it;
+        const GLenum status =
+            glClientWaitSync(job->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_TIMEOUT_EXPIRED) {
+            struct TextureJob* next = job->next;
+            if (finish_texture_job(job)) {
+                *it = next;
+                continue;
+            }
+        }
+        it = &(job->next);
+    }
+
+    // Start uploads for decoded textures while there are free PBOs
+    size_t uploaded = 0;
+    while (wait || uploaded < TEXTURE_UPLOAD_BUDGET) {
+        size_t slot = 0;
+        while (slot < TEXTURE_PBO_RING && texture_pbos[slot].busy)
+            slot++;
+        if (slot >= TEXTURE_PBO_RING)
             break;
-        case SDL_PIXELFORMAT_RGBA128_FLOAT:
-            format = GL_RGBA32F;
+
+        SDL_LockMutex(texture_mutex);
+        if (wait)
+            while (texture_ready == NULL && texture_jobs > 0 && texture_uploads == NULL)
+                SDL_WaitCondition(texture_decoded, texture_mutex);
+        struct TextureJob* job = pop_texture_job(&texture_ready, &texture_ready_tail);
+        SDL_UnlockMutex(texture_mutex);
+        if (job == NULL)
             break;
+
+        struct Texture* texture = job->texture;
+        if (texture == NULL || job->buffer == NULL) {
+            if (job->stream)
+                texture_streams--;
+            if (texture != NULL) {
+                texture->job = NULL;
+                if (job->stream)
+                    lame_free(&(texture->cache_path)); // Stop streaming it
+            }
+            free_texture_job(job);
+            continue;
+        }
+
+        // New textures start at their base level unless they're pinned or
+        // can't be streamed back in
+        if (!job->stream) {
+            texture->size[0] = job->size[0];
+            texture->size[1] = job->size[1];
+            if (!texture->resident && job->cached)
+                job->lod = base_texture_lod(job->size, job->num_levels);
+        }
+        uploaded += upload_texture_job(job, slot);
+        job->next = texture_uploads;
+        texture_uploads = job;
     }
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, format, surface->w, surface->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels);
-    SDL_DestroySurface(surface);
+bool finish_texture(struct Texture* texture) {
+    video_sync(); // See load_model()
+
+    // Pin it at full resolution
+    texture->resident = true;
+    while (texture->job != NULL || (texture->lod > 0 && texture->cache_path != NULL)) {
+        if (texture->job == NULL)
+            stream_texture(texture, 0);
+        update_textures(true);
+    }
+    return texture->texture != 0;
+}
+
+void load_texture(const char* name) {
+    if (get_texture(name) != NULL)
+        return;
+
+    SDL_snprintf(asset_file_helper, sizeof(asset_file_helper), "textures/%s.*", name);
+    const char* file = get_mod_file(asset_file_helper, ".json");
+    if (file == NULL) {
+        WARN("Texture \"%s\" not found", name);
+        return;
+    }
+
+    // Texture struct
+    struct Texture* texture = lame_alloc_clean(sizeof(struct Texture));
+
+    // General
+    texture->name = SDL_strdup(name);
+    texture->uvs[2] = texture->uvs[3] = 1;
+
+    // Data is decoded on the loader thread and uploaded in update_textures(),
+    // the blank texture is drawn in its place until then
+    struct TextureJob* job = lame_alloc_clean(sizeof(struct TextureJob));
+    job->texture = texture;
+    job->name = SDL_strdup(name);
+    SDL_strlcpy(job->file, file, sizeof(job->file));
+    SDL_strlcpy(job->cache_path, get_pref_path(TEXTURE_CACHE_PATH), sizeof(job->cache_path));
+    job->compress = texture_compression && gpu_supports_s3tc();
+    texture->job = job;
+    queue_texture_job(job);
 
     texture->userdata = create_pointer_ref("texture", texture);
     ASSET_SANITY_PUSH(texture, textures);
@@ -212,14 +895,71 @@ void destroy_texture(struct Texture* texture) {
     ASSET_SANITY_POP(texture, textures);
     unreference_pointer(&(texture->userdata));
 
-    if (texture->parent == NULL)
+    if (texture->job != NULL)
+        texture->job->texture = NULL;
+    if (texture->parent == NULL && texture->texture != 0) {
+        untrack_texture(texture->texture);
         glDeleteTextures(1, &(texture->texture));
+        invalidate_gl_state();
+    }
+    texture_vram -= texture->vram;
+    if (texture->cache_path != NULL)
+        lame_free(&(texture->cache_path));
 
     DEBUG("Freed texture \"%s\" (%u)", texture->name, texture);
     lame_free(&(texture->name));
     lame_free(&texture);
 }
 
+static void texture_loader_init() {
+    if (!SDL_CreateDirectory(get_pref_path(TEXTURE_CACHE_PATH)))
+        WARN("Can't create texture cache: %s", SDL_GetError());
+
+    texture_mutex = SDL_CreateMutex();
+    texture_queued = SDL_CreateCondition();
+    texture_decoded = SDL_CreateCondition();
+    if (texture_mutex == NULL || texture_queued == NULL || texture_decoded == NULL)
+        FATAL("Texture loader sync fail: %s", SDL_GetError());
+
+    texture_quit = false;
+    texture_thread = SDL_CreateThread(texture_loop, "textures", NULL);
+    if (texture_thread == NULL)
+        FATAL("Texture loader thread fail: %s", SDL_GetError());
+}
+
+static void texture_loader_teardown() {
+    SDL_LockMutex(texture_mutex);
+    texture_quit = true;
+    SDL_SignalCondition(texture_queued);
+    SDL_UnlockMutex(texture_mutex);
+    SDL_WaitThread(texture_thread, NULL);
+    texture_thread = NULL;
+
+    // Textures are gone by now, so every leftover job is orphaned
+    struct TextureJob* job;
+    while ((job = pop_texture_job(&texture_queue, &texture_queue_tail)) != NULL)
+        free_texture_job(job);
+    while ((job = pop_texture_job(&texture_ready, &texture_ready_tail)) != NULL)
+        free_texture_job(job);
+    while (texture_uploads != NULL) {
+        job = texture_uploads;
+        texture_uploads = job->next;
+        finish_texture_job(job);
+    }
+    texture_jobs = texture_streams = 0;
+
+    for (size_t i = 0; i < TEXTURE_PBO_RING; i++)
+        if (texture_pbos[i].buffer != 0) {
+            untrack_buffer(texture_pbos[i].buffer);
+            glDeleteBuffers(1, &(texture_pbos[i].buffer));
+            texture_pbos[i].capacity = 0;
+        }
+
+    CLOSE_POINTER(texture_decoded, SDL_DestroyCondition);
+    CLOSE_POINTER(texture_queued, SDL_DestroyCondition);
+    CLOSE_POINTER(texture_mutex, SDL_DestroyMutex);
+}
+
 // Materials
 SOURCE_ASSET(materials, material, struct Material*);
 
@@ -350,30 +1090,23 @@ void destroy_material(struct Material* material) {
 // Models
 SOURCE_ASSET(models, model, struct Model*);
 
-static struct Node* read_node(uint8_t** cursor, struct Node* parent) {
+static struct Node* read_node(struct BinaryReader* reader, struct Node* parent) {
     struct Node* node = lame_alloc_clean(sizeof(struct Node));
-    node->name = read_string(cursor);
-    node->index = read_f32(cursor);
-    node->bone = read_bool(cursor);
-
-    node->dq[0] = read_u32(cursor);
-    node->dq[1] = read_u32(cursor);
-    node->dq[2] = read_u32(cursor);
-    node->dq[3] = read_u32(cursor);
-    node->dq[4] = read_u32(cursor);
-    node->dq[5] = read_u32(cursor);
-    node->dq[6] = read_u32(cursor);
-    node->dq[7] = read_u32(cursor);
-
-    for (size_t i = read_u32(cursor); i > 0; i--) // Mesh count
-        read_u32(cursor);                         // Mesh index
+    node->name = read_string(reader);
+    node->index = read_f32(reader);
+    node->bone = read_bool(reader);
+    read_f32_array(reader, node->dq, 8);
+
+    skip_bytes(reader, read_u32(reader) * sizeof(uint32_t)); // Mesh indices
 
     node->parent = parent;
-    node->num_children = read_u32(cursor);
+    node->num_children = read_u32(reader);
+    if (node->num_children > reader_remaining(reader))
+        FATAL("Node \"%s\" has more children (%zu) than the file has bytes", node->name, node->num_children);
     if ((node->num_children) > 0) {
         node->children = (struct Node**)lame_alloc(node->num_children * sizeof(struct Node*));
         for (size_t i = 0; i < node->num_children; i++)
-            node->children[i] = read_node(cursor, node);
+            node->children[i] = read_node(reader, node);
     }
 
     return node;
@@ -390,6 +1123,62 @@ static void destroy_node(struct Node* node) {
     lame_free(&node);
 }
 
+static void create_world_buffers(
+    GLuint* vao, GLuint* vbo, const struct WorldVertex* vertices, size_t num_vertices, const char* owner
+) {
+    glGenVertexArrays(1, vao);
+    bind_vertex_array(*vao);
+    glEnableVertexArrayAttrib(*vao, VATT_POSITION);
+    glVertexArrayAttribFormat(*vao, VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
+    glEnableVertexArrayAttrib(*vao, VATT_NORMAL);
+    glVertexArrayAttribFormat(*vao, VATT_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
+    glEnableVertexArrayAttrib(*vao, VATT_COLOR);
+    glVertexArrayAttribFormat(*vao, VATT_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLubyte) * 4);
+    glEnableVertexArrayAttrib(*vao, VATT_UV);
+    glVertexArrayAttribFormat(*vao, VATT_UV, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
+    glEnableVertexArrayAttrib(*vao, VATT_BONE_INDEX);
+    glVertexArrayAttribFormat(*vao, VATT_BONE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
+    glEnableVertexArrayAttrib(*vao, VATT_BONE_WEIGHT);
+    glVertexArrayAttribFormat(*vao, VATT_BONE_WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
+
+    glGenBuffers(1, vbo);
+    bind_array_buffer(*vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct WorldVertex) * num_vertices), vertices, GL_STATIC_DRAW);
+    track_buffer(*vbo, GMT_MODEL, owner, sizeof(struct WorldVertex) * num_vertices);
+
+    glEnableVertexAttribArray(VATT_POSITION);
+    glVertexAttribPointer(
+        VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, position)
+    );
+
+    glEnableVertexAttribArray(VATT_NORMAL);
+    glVertexAttribPointer(
+        VATT_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, normal)
+    );
+
+    glEnableVertexAttribArray(VATT_COLOR);
+    glVertexAttribPointer(
+        VATT_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, color)
+    );
+
+    glEnableVertexAttribArray(VATT_UV);
+    glVertexAttribPointer(
+        VATT_UV, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, uv)
+    );
+
+    glEnableVertexAttribArray(VATT_BONE_INDEX);
+    glVertexAttribPointer(
+        VATT_BONE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
+        (void*)offsetof(struct WorldVertex, bone_index)
+    );
+
+    glEnableVertexAttribArray(VATT_BONE_WEIGHT);
+    glVertexAttribPointer(
+        VATT_BONE_WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
+        (void*)offsetof(struct WorldVertex, bone_weight)
+    );
+}
+
 void load_model(const char* name) {
     if (get_model(name) != NULL)
         return;
@@ -401,31 +1190,32 @@ void load_model(const char* name) {
         return;
     }
 
-    void* buffer = SDL_LoadFile(file, NULL);
+    size_t size;
+    void* buffer = SDL_LoadFile(file, &size);
     if (buffer == NULL) {
         WTF("Model \"%s\" load fail: %s", name, SDL_GetError());
         return;
     }
-    uint8_t* cursor = buffer;
+    struct BinaryReader reader = binary_reader(buffer, size);
+
+    // Uploading needs the context, models fetched during the tick take it
+    // back from the present thread early
+    video_sync();
 
     // File header
     bool has_minor;
-    if (SDL_strcmp((const char*)cursor, "bbmod") == 0) {
+    if (read_magic(&reader, "bbmod"))
         has_minor = false;
-        cursor += sizeof("bbmod");
-    } else if (SDL_strcmp((const char*)cursor, "BBMOD") == 0) {
+    else if (read_magic(&reader, "BBMOD"))
         has_minor = true;
-        cursor += sizeof("BBMOD");
-    } else {
-        FATAL("Invalid header in model \"%s\"");
-    }
+    else
+        FATAL("Invalid header in model \"%s\"", name);
 
-    uint8_t major = read_u8(&cursor);
-    uint8_t minor = 0;
+    uint8_t major = read_u8(&reader);
     if (major != BBMOD_VERSION_MAJOR)
         FATAL("Bad BBMOD major version in model \"%s\" (%u =/= %u)", name, major, BBMOD_VERSION_MAJOR);
     if (has_minor) {
-        uint8_t minor = read_u8(&cursor);
+        uint8_t minor = read_u8(&reader);
         if (minor < 2)
             FATAL(
                 "Bad BBMOD version in model \"%s\" (%u.%u < %u.%u)", name, major, minor, BBMOD_VERSION_MAJOR,
@@ -445,22 +1235,20 @@ void load_model(const char* name) {
     model->name = SDL_strdup(name);
 
     // Submodels
-    model->num_submodels = read_u32(&cursor);
+    model->num_submodels = read_u32(&reader);
+    if (model->num_submodels > reader_remaining(&reader))
+        FATAL("Model \"%s\" is truncated", name);
     if (model->num_submodels > 0) {
         model->submodels = lame_alloc(model->num_submodels * sizeof(struct Submodel));
         for (size_t i = 0; i < model->num_submodels; i++) {
             struct Submodel* submodel = &(model->submodels[i]);
 
             // Material index
-            submodel->material = read_u32(&cursor);
+            submodel->material = read_u32(&reader);
 
             // Bounding box
-            read_f32(&cursor);
-            read_f32(&cursor);
-            read_f32(&cursor);
-            read_f32(&cursor);
-            read_f32(&cursor);
-            read_f32(&cursor);
+            read_f32_array(&reader, submodel->bounds[0], 3);
+            read_f32_array(&reader, submodel->bounds[1], 3);
 
             /* Vertex format
                lameo only needs the following attributes:
@@ -475,171 +1263,100 @@ void load_model(const char* name) {
                The rest are bogus:
                 - Tangents
                 - Indices */
-            bool has_position = read_bool(&cursor);
-            bool has_normals = read_bool(&cursor);
-            bool has_uvs = read_bool(&cursor);
-            bool has_uvs2 = read_bool(&cursor);
-            bool has_color = read_bool(&cursor);
-            bool has_tangents = read_bool(&cursor);
-            bool has_bones = read_bool(&cursor);
-            bool has_id = read_bool(&cursor);
-            read_u32(&cursor); // Skip primitive type (it's always GL_TRIANGLES)
+            bool has_position = read_bool(&reader);
+            bool has_normals = read_bool(&reader);
+            bool has_uvs = read_bool(&reader);
+            bool has_uvs2 = read_bool(&reader);
+            bool has_color = read_bool(&reader);
+            bool has_tangents = read_bool(&reader);
+            bool has_bones = read_bool(&reader);
+            bool has_id = read_bool(&reader);
+            read_u32(&reader); // Skip primitive type (it's always GL_TRIANGLES)
 
             // Vertices
-            submodel->num_vertices = read_u32(&cursor);
+            const size_t stride = (has_position ? 3 * sizeof(float) : 0) + (has_normals ? 3 * sizeof(float) : 0) +
+                                  (has_uvs ? 2 * sizeof(float) : 0) + (has_uvs2 ? 2 * sizeof(float) : 0) +
+                                  (has_color ? 4 * sizeof(uint8_t) : 0) + (has_tangents ? 4 * sizeof(float) : 0) +
+                                  (has_bones ? 8 * sizeof(float) : 0) + (has_id ? sizeof(float) : 0);
+            submodel->num_vertices = read_u32(&reader);
+            if (stride > 0 && submodel->num_vertices > reader_remaining(&reader) / stride)
+                FATAL("Model \"%s\" is truncated (submodel %zu vertices)", name, i);
             submodel->vertices = lame_alloc_clean(submodel->num_vertices * sizeof(struct WorldVertex));
 
             for (size_t j = 0; j < submodel->num_vertices; j++) {
                 struct WorldVertex* vertex = &(submodel->vertices[j]);
 
-                if (has_position) {
-                    vertex->position[0] = read_f32(&cursor);
-                    vertex->position[1] = read_f32(&cursor);
-                    vertex->position[2] = read_f32(&cursor);
-                }
+                if (has_position)
+                    read_f32_array(&reader, vertex->position, 3);
 
-                if (has_normals) {
-                    vertex->normal[0] = read_f32(&cursor);
-                    vertex->normal[1] = read_f32(&cursor);
-                    vertex->normal[2] = read_f32(&cursor);
-                } else {
+                if (has_normals)
+                    read_f32_array(&reader, vertex->normal, 3);
+                else
                     vertex->normal[2] = -1;
-                }
 
-                if (has_uvs) {
-                    vertex->uv[0] = read_f32(&cursor);
-                    vertex->uv[1] = read_f32(&cursor);
-                }
+                if (has_uvs)
+                    read_f32_array(&reader, vertex->uv, 2);
 
-                if (has_uvs2) {
-                    vertex->uv[2] = read_f32(&cursor);
-                    vertex->uv[3] = read_f32(&cursor);
-                }
+                if (has_uvs2)
+                    read_f32_array(&reader, vertex->uv + 2, 2);
 
-                if (has_color) {
-                    vertex->color[0] = read_u8(&cursor);
-                    vertex->color[1] = read_u8(&cursor);
-                    vertex->color[2] = read_u8(&cursor);
-                    vertex->color[3] = read_u8(&cursor);
-                } else {
+                if (has_color)
+                    read_u8_array(&reader, vertex->color, 4);
+                else
                     vertex->color[0] = vertex->color[1] = vertex->color[2] = vertex->color[3] = 255;
-                }
 
-                if (has_tangents) {
-                    read_f32(&cursor);
-                    read_f32(&cursor);
-                    read_f32(&cursor);
-                    read_f32(&cursor);
-                }
+                if (has_tangents)
+                    skip_bytes(&reader, 4 * sizeof(float));
 
                 if (has_bones) {
-                    vertex->bone_index[0] = read_f32(&cursor);
-                    vertex->bone_index[1] = read_f32(&cursor);
-                    vertex->bone_index[2] = read_f32(&cursor);
-                    vertex->bone_index[3] = read_f32(&cursor);
-                    vertex->bone_weight[0] = read_f32(&cursor);
-                    vertex->bone_weight[1] = read_f32(&cursor);
-                    vertex->bone_weight[2] = read_f32(&cursor);
-                    vertex->bone_weight[3] = read_f32(&cursor);
+                    read_f32_array(&reader, vertex->bone_index, 4);
+                    read_f32_array(&reader, vertex->bone_weight, 4);
                 }
 
-                if (has_id) {
-                    read_f32(&cursor);
-                }
+                if (has_id)
+                    skip_bytes(&reader, sizeof(float));
             }
 
             // VAO and VBO
-            glGenVertexArrays(1, &submodel->vao);
-            glBindVertexArray(submodel->vao);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_POSITION);
-            glVertexArrayAttribFormat(submodel->vao, VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_NORMAL);
-            glVertexArrayAttribFormat(submodel->vao, VATT_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_COLOR);
-            glVertexArrayAttribFormat(submodel->vao, VATT_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLubyte) * 4);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_UV);
-            glVertexArrayAttribFormat(submodel->vao, VATT_UV, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_BONE_INDEX);
-            glVertexArrayAttribFormat(submodel->vao, VATT_BONE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
-            glEnableVertexArrayAttrib(submodel->vao, VATT_BONE_WEIGHT);
-            glVertexArrayAttribFormat(submodel->vao, VATT_BONE_WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4);
-
-            glGenBuffers(1, &submodel->vbo);
-            glBindBuffer(GL_ARRAY_BUFFER, submodel->vbo);
-            glBufferData(
-                GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct WorldVertex) * submodel->num_vertices), submodel->vertices,
-                GL_STATIC_DRAW
-            );
-
-            glEnableVertexAttribArray(VATT_POSITION);
-            glVertexAttribPointer(
-                VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
-                (void*)offsetof(struct WorldVertex, position)
-            );
-
-            glEnableVertexAttribArray(VATT_NORMAL);
-            glVertexAttribPointer(
-                VATT_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
-                (void*)offsetof(struct WorldVertex, normal)
-            );
-
-            glEnableVertexAttribArray(VATT_COLOR);
-            glVertexAttribPointer(
-                VATT_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct WorldVertex),
-                (void*)offsetof(struct WorldVertex, color)
-            );
-
-            glEnableVertexAttribArray(VATT_UV);
-            glVertexAttribPointer(
-                VATT_UV, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, uv)
-            );
-
-            glEnableVertexAttribArray(VATT_BONE_INDEX);
-            glVertexAttribPointer(
-                VATT_BONE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
-                (void*)offsetof(struct WorldVertex, bone_index)
-            );
-
-            glEnableVertexAttribArray(VATT_BONE_WEIGHT);
-            glVertexAttribPointer(
-                VATT_BONE_WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
-                (void*)offsetof(struct WorldVertex, bone_weight)
+            create_world_buffers(
+                &submodel->vao, &submodel->vbo, submodel->vertices, submodel->num_vertices, model->name
             );
         }
     }
 
     // Nodes
-    model->root_node = ((model->num_nodes = read_u32(&cursor)) > 0) ? read_node(&cursor, NULL) : NULL;
+    model->root_node = ((model->num_nodes = read_u32(&reader)) > 0) ? read_node(&reader, NULL) : NULL;
 
     // Bones
-    model->num_bones = read_u32(&cursor);
+    model->num_bones = read_u32(&reader);
+    if (model->num_bones > reader_remaining(&reader) / (9 * sizeof(float)))
+        FATAL("Model \"%s\" is truncated (%zu bones)", name, model->num_bones);
     if (model->num_bones > 0) {
         model->bone_offsets = lame_alloc(model->num_bones * sizeof(DualQuaternion));
         for (size_t i = 0; i < model->num_bones; i++) {
-            DualQuaternion* dq = &(model->bone_offsets[(size_t)read_f32(&cursor)]);
-            (*dq)[0] = read_f32(&cursor);
-            (*dq)[1] = read_f32(&cursor);
-            (*dq)[2] = read_f32(&cursor);
-            (*dq)[3] = read_f32(&cursor);
-            (*dq)[4] = read_f32(&cursor);
-            (*dq)[5] = read_f32(&cursor);
-            (*dq)[6] = read_f32(&cursor);
-            (*dq)[7] = read_f32(&cursor);
+            const size_t index = (size_t)read_f32(&reader);
+            if (index >= model->num_bones)
+                FATAL("Model \"%s\" has invalid bone index %zu (%zu bones)", name, index, model->num_bones);
+            read_f32_array(&reader, model->bone_offsets[index], 8);
         }
     }
 
     // Materials
-    model->num_materials = read_u32(&cursor);
+    model->num_materials = read_u32(&reader);
+    if (model->num_materials > reader_remaining(&reader))
+        FATAL("Model \"%s\" is truncated (%zu materials)", name, model->num_materials);
     if (model->num_materials > 0) {
         model->materials = (struct Material**)lame_alloc_clean(model->num_materials * sizeof(struct Material*));
         for (size_t i = 0; i < model->num_materials; i++) {
-            const char* material_name = read_string(&cursor);
+            const char* material_name = read_string(&reader);
             if (material_name[0] != '\0')
                 model->materials[i] = fetch_material(material_name);
             lame_free(&material_name);
         }
     }
 
+    if (reader.overflow)
+        FATAL("Model \"%s\" is truncated", name);
     lame_free(&buffer);
 
     // Extras
@@ -653,6 +1370,10 @@ void load_model(const char* name) {
                 yyjson_val* value = yyjson_obj_get(root, "lightmap");
                 if (yyjson_is_str(value))
                     model->lightmap = fetch_texture(yyjson_get_str(value));
+
+                value = yyjson_obj_get(root, "static");
+                if (yyjson_is_bool(value) && yyjson_get_bool(value))
+                    batch_model(model);
             }
 
             yyjson_doc_free(json);
@@ -671,13 +1392,28 @@ void destroy_model(struct Model* model) {
     if (model->submodels != NULL) {
         for (size_t i = 0; i < model->num_submodels; i++) {
             struct Submodel* submodel = &(model->submodels[i]);
-            glDeleteVertexArrays(1, &(submodel->vao));
-            glDeleteBuffers(1, &(submodel->vbo));
-            lame_free(&(submodel->vertices));
+            if (submodel->vbo != 0) {
+                glDeleteVertexArrays(1, &(submodel->vao));
+                untrack_buffer(submodel->vbo);
+                glDeleteBuffers(1, &(submodel->vbo));
+            }
+            FREE_POINTER(submodel->vertices);
         }
         lame_free(&(model->submodels));
     }
 
+    if (model->batches != NULL) {
+        for (size_t i = 0; i < model->num_batches; i++) {
+            struct ModelBatch* batch = &(model->batches[i]);
+            glDeleteVertexArrays(1, &(batch->vao));
+            untrack_buffer(batch->vbo);
+            glDeleteBuffers(1, &(batch->vbo));
+            lame_free(&(batch->chunks));
+        }
+        lame_free(&(model->batches));
+    }
+    invalidate_gl_state();
+
     CLOSE_POINTER(model->root_node, destroy_node);
     FREE_POINTER(model->bone_offsets);
     FREE_POINTER(model->materials);
@@ -687,6 +1423,95 @@ void destroy_model(struct Model* model) {
     lame_free(&model);
 }
 
+// Alpha tested materials are cut out, anything else blends with what's behind
+// it and has to keep its draw order
+static bool material_blends(const struct Material* material) {
+    return material != NULL && material->alpha_test <= 0;
+}
+
+void batch_model(struct Model* model) {
+    // Skinned models can't be merged since every submodel moves on its own
+    if (model->batches != NULL || model->num_bones > 0 || model->num_submodels <= 1)
+        return;
+
+    // Opaque submodels are merged by material, in the batch of the first one
+    // that uses it. Blended submodels get a batch each so they still draw in
+    // their original order.
+    size_t* heads = lame_alloc(model->num_submodels * sizeof(size_t));
+    size_t num_batches = 0;
+    for (size_t i = 0; i < model->num_submodels; i++) {
+        const size_t material = model->submodels[i].material;
+        bool found = false;
+        if (!material_blends(model->materials[material]))
+            for (size_t j = 0; j < i; j++)
+                if (model->submodels[j].material == material) {
+                    found = true;
+                    break;
+                }
+        if (!found)
+            heads[num_batches++] = i;
+    }
+
+    if (num_batches >= model->num_submodels) {
+        lame_free(&heads);
+        return;
+    }
+    video_sync(); // See load_model()
+
+    model->batches = lame_alloc_clean(num_batches * sizeof(struct ModelBatch));
+    model->num_batches = num_batches;
+    for (size_t i = 0; i < num_batches; i++) {
+        struct ModelBatch* batch = &(model->batches[i]);
+        batch->material = model->submodels[heads[i]].material;
+        const bool single = material_blends(model->materials[batch->material]);
+
+        for (size_t j = heads[i]; j < model->num_submodels; j++) {
+            const struct Submodel* submodel = &(model->submodels[j]);
+            if (submodel->material == batch->material) {
+                batch->num_vertices += submodel->num_vertices;
+                batch->num_chunks++;
+                if (single)
+                    break;
+            }
+        }
+
+        struct WorldVertex* vertices = lame_alloc(batch->num_vertices * sizeof(struct WorldVertex));
+        batch->chunks = lame_alloc(batch->num_chunks * sizeof(struct ModelChunk));
+        size_t first = 0, k = 0;
+        for (size_t j = heads[i]; j < model->num_submodels && k < batch->num_chunks; j++) {
+            const struct Submodel* submodel = &(model->submodels[j]);
+            if (submodel->material != batch->material)
+                continue;
+
+            lame_copy(&vertices[first], submodel->vertices, submodel->num_vertices * sizeof(struct WorldVertex));
+            struct ModelChunk* chunk = &(batch->chunks[k++]);
+            chunk->submodel = j;
+            chunk->first = (GLint)first;
+            chunk->count = (GLsizei)submodel->num_vertices;
+            glm_vec3_copy((float*)submodel->bounds[0], chunk->bounds[0]);
+            glm_vec3_copy((float*)submodel->bounds[1], chunk->bounds[1]);
+            first += submodel->num_vertices;
+        }
+
+        create_world_buffers(&batch->vao, &batch->vbo, vertices, batch->num_vertices, model->name);
+        lame_free(&vertices);
+    }
+
+    // Everything is drawn from the batches now
+    for (size_t i = 0; i < model->num_submodels; i++) {
+        struct Submodel* submodel = &(model->submodels[i]);
+        glDeleteVertexArrays(1, &(submodel->vao));
+        untrack_buffer(submodel->vbo);
+        glDeleteBuffers(1, &(submodel->vbo));
+        submodel->vao = submodel->vbo = 0;
+        lame_free(&(submodel->vertices));
+    }
+    invalidate_gl_state();
+
+    lame_free(&heads);
+    DEBUG("Batched model \"%s\" (%zu submodels -> %zu batches)", model->name, model->num_submodels, num_batches);
+}
+
 // Animations
 SOURCE_ASSET(animations, animation, struct Animation*);
 
@@ -701,31 +1526,28 @@ void load_animation(const char* name) {
         return;
     }
 
-    void* buffer = SDL_LoadFile(file, NULL);
+    size_t size;
+    void* buffer = SDL_LoadFile(file, &size);
     if (buffer == NULL) {
-        WTF("Animation \"%s\" load fail: %s", SDL_GetError());
+        WTF("Animation \"%s\" load fail: %s", name, SDL_GetError());
         return;
     }
-    uint8_t* cursor = buffer;
+    struct BinaryReader reader = binary_reader(buffer, size);
 
     // File header
     bool has_minor;
-    if (SDL_strcmp((const char*)cursor, "bbanim") == 0) {
+    if (read_magic(&reader, "bbanim"))
         has_minor = false;
-        cursor += sizeof("bbanim");
-    } else if (SDL_strcmp((const char*)cursor, "BBANIM") == 0) {
+    else if (read_magic(&reader, "BBANIM"))
         has_minor = true;
-        cursor += sizeof("BBANIM");
-    } else {
-        FATAL("Invalid header in animation \"%s\"");
-    }
+    else
+        FATAL("Invalid header in animation \"%s\"", name);
 
-    uint8_t major = read_u8(&cursor);
-    uint8_t minor = 0;
+    uint8_t major = read_u8(&reader);
     if (major != BBMOD_VERSION_MAJOR)
         FATAL("Bad BBMOD major version in animation \"%s\" (%u =/= %u)", name, major, BBMOD_VERSION_MAJOR);
     if (has_minor) {
-        uint8_t minor = read_u8(&cursor);
+        uint8_t minor = read_u8(&reader);
         if (minor < 2)
             FATAL(
                 "Bad BBMOD version in animation \"%s\" (%u.%u < %u.%u)", name, major, minor, BBMOD_VERSION_MAJOR,
@@ -745,63 +1567,44 @@ void load_animation(const char* name) {
     animation->name = SDL_strdup(name);
 
     // Data
-    enum BoneSpaces spaces = (enum BoneSpaces)(read_u8(&cursor));
-    animation->num_frames = (size_t)(read_f64(&cursor));
-    animation->frame_speed = (float)(read_f64(&cursor) / (double)TICKRATE);
+    enum BoneSpaces spaces = (enum BoneSpaces)(read_u8(&reader));
+    animation->num_frames = (size_t)(read_f64(&reader));
+    animation->frame_speed = (float)(read_f64(&reader) / (double)TICKRATE);
+
+    animation->num_nodes = (size_t)(read_u32(&reader));
+    animation->num_bones = (size_t)(read_u32(&reader));
+
+    // Every frame is a run of dual quaternions per bone space, so check the whole thing once
+    const size_t frame_size = (((spaces & BS_PARENT) ? animation->num_nodes : 0) +
+                               ((spaces & BS_WORLD) ? animation->num_nodes : 0) +
+                               ((spaces & BS_BONE) ? animation->num_bones : 0)) *
+                              sizeof(DualQuaternion);
+    if (frame_size > 0 && animation->num_frames > reader_remaining(&reader) / frame_size)
+        FATAL("Animation \"%s\" is truncated (%zu frames)", name, animation->num_frames);
 
-    animation->num_nodes = (size_t)(read_u32(&cursor));
-    animation->num_bones = (size_t)(read_u32(&cursor));
     if (spaces & BS_PARENT)
         animation->parent_frames = (DualQuaternion**)lame_alloc(animation->num_frames * sizeof(DualQuaternion*));
     if (spaces & BS_WORLD)
         animation->world_frames = (DualQuaternion**)lame_alloc(animation->num_frames * sizeof(DualQuaternion*));
     if (spaces & BS_BONE)
         animation->bone_frames = (DualQuaternion**)lame_alloc(animation->num_frames * sizeof(DualQuaternion*));
-    ;
 
     for (size_t i = 0; i < animation->num_frames; i++) {
         if (animation->parent_frames != NULL) {
             DualQuaternion* frame = (DualQuaternion*)lame_alloc(animation->num_nodes * sizeof(DualQuaternion));
-            for (size_t j = 0; j < animation->num_nodes; j++) {
-                frame[j][0] = read_f32(&cursor);
-                frame[j][1] = read_f32(&cursor);
-                frame[j][2] = read_f32(&cursor);
-                frame[j][3] = read_f32(&cursor);
-                frame[j][4] = read_f32(&cursor);
-                frame[j][5] = read_f32(&cursor);
-                frame[j][6] = read_f32(&cursor);
-                frame[j][7] = read_f32(&cursor);
-            }
+            read_f32_array(&reader, (float*)frame, animation->num_nodes * 8);
             animation->parent_frames[i] = frame;
         }
 
         if (animation->world_frames != NULL) {
             DualQuaternion* frame = lame_alloc(animation->num_nodes * sizeof(DualQuaternion));
-            for (size_t j = 0; j < animation->num_nodes; j++) {
-                frame[j][0] = read_f32(&cursor);
-                frame[j][1] = read_f32(&cursor);
-                frame[j][2] = read_f32(&cursor);
-                frame[j][3] = read_f32(&cursor);
-                frame[j][4] = read_f32(&cursor);
-                frame[j][5] = read_f32(&cursor);
-                frame[j][6] = read_f32(&cursor);
-                frame[j][7] = read_f32(&cursor);
-            }
+            read_f32_array(&reader, (float*)frame, animation->num_nodes * 8);
             animation->world_frames[i] = frame;
         }
 
         if (animation->bone_frames != NULL) {
             DualQuaternion* frame = lame_alloc(animation->num_bones * sizeof(DualQuaternion));
-            for (size_t j = 0; j < animation->num_bones; j++) {
-                frame[j][0] = read_f32(&cursor);
-                frame[j][1] = read_f32(&cursor);
-                frame[j][2] = read_f32(&cursor);
-                frame[j][3] = read_f32(&cursor);
-                frame[j][4] = read_f32(&cursor);
-                frame[j][5] = read_f32(&cursor);
-                frame[j][6] = read_f32(&cursor);
-                frame[j][7] = read_f32(&cursor);
-            }
+            read_f32_array(&reader, (float*)frame, animation->num_bones * 8);
             animation->bone_frames[i] = frame;
         }
     }
@@ -875,7 +1678,7 @@ void load_font(const char* name) {
     yyjson_val* value = yyjson_obj_get(root, "texture");
     if (yyjson_is_str(value)) {
         texture = fetch_texture(yyjson_get_str(value));
-        if (texture == NULL)
+        if (texture == NULL || !finish_texture(texture)) // Glyphs need its size
             FATAL("Font texture \"%s\" not found", name);
         font->texture = texture;
     } else {
@@ -1139,6 +1942,7 @@ void destroy_track(struct Track* track) {
 void asset_init() {
     shaders_init();
     textures_init();
+    texture_loader_init();
     materials_init();
     models_init();
     animations_init();
@@ -1151,6 +1955,7 @@ void asset_init() {
 
 void asset_teardown() {
     clear_assets(true);
+    texture_loader_teardown();
 
     shaders_teardown();
     textures_teardown();
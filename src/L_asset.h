@@ -9,6 +9,7 @@ struct Animation;
 struct Font;
 struct Sound;
 struct Track;
+struct TextureJob;
 
 #include "L_math.h"
 #include "L_memory.h"
@@ -19,6 +20,22 @@ struct Track;
 #define BBMOD_VERSION_MAJOR 3
 #define BBMOD_VERSION_MINOR 4
 
+#define TEXTURE_CACHE_PATH "cache/textures/"
+#define TEXTURE_CACHE_MAGIC 0x5845544C // "LTEX"
+#define TEXTURE_CACHE_VERSION 1
+#define TEXTURE_CACHE_HEADER (6 * sizeof(uint32_t))
+#define TEXTURE_MAX_LEVELS 16
+#define TEXTURE_PBO_RING 4
+#define TEXTURE_UPLOAD_BUDGET 4194304 // Bytes per frame
+#define TEXTURE_STREAM_BASE_SIZE 64   // Largest dimension that textures are loaded in at
+#define TEXTURE_STREAM_DISTANCE 256   // Distance that full resolution is requested within
+#define TEXTURE_STREAM_LINGER 120     // Frames until an unused texture can be evicted
+#define TEXTURE_STREAM_JOBS 2
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 #define BEGIN_ASSET(assettype)                                                                                         \
     struct assettype {                                                                                                 \
         const char* name;                                                                                              \
@@ -34,6 +51,8 @@ struct Track;
     void load_##assetname(const char*);                                                                                \
     struct assettype* fetch_##assetname(const char*);                                                                  \
     struct assettype* get_##assetname(const char*);                                                                    \
+    struct assettype* fetch_##assetname##_atom(Atom);                                                                  \
+    struct assettype* get_##assetname##_atom(Atom);                                                                    \
     void destroy_##assetname(struct assettype*);                                                                       \
     void clear_##mapname(bool);
 
@@ -57,14 +76,27 @@ struct Track;
         return get_##assetname(name);                                                                                  \
     }                                                                                                                  \
                                                                                                                        \
+    assettype get_##assetname##_atom(Atom name) {                                                                      \
+        return (assettype)from_hash_map_atom(mapname, name);                                                           \
+    }                                                                                                                  \
+                                                                                                                       \
+    assettype fetch_##assetname##_atom(Atom name) {                                                                    \
+        assettype asset = get_##assetname##_atom(name);                                                                \
+        return (asset != NULL) ? asset : fetch_##assetname(name);                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
     void clear_##mapname(bool teardown) {                                                                              \
-        for (size_t i = 0; (mapname)->count > 0 && i < (mapname)->capacity; i++) {                                     \
+        /* Destroying pops the asset, which can shift the next one into this slot */                                   \
+        for (size_t i = 0; (mapname)->count > 0 && i < (mapname)->capacity;) {                                         \
             struct KeyValuePair* kvp = &(mapname)->items[i];                                                           \
-            if (kvp->key == NULL || kvp->key == HASH_TOMBSTONE)                                                        \
-                continue;                                                                                              \
             assettype asset = kvp->value;                                                                              \
-            if (asset != NULL && (!asset->transient || teardown))                                                      \
-                destroy_##assetname(asset);                                                                            \
+            if (kvp->key == NULL || asset == NULL || (asset->transient && !teardown)) {                                \
+                i++;                                                                                                   \
+                continue;                                                                                              \
+            }                                                                                                          \
+            destroy_##assetname(asset);                                                                                \
+            if (kvp->value == asset)                                                                                   \
+                i++;                                                                                                   \
         }                                                                                                              \
     }
 
@@ -95,18 +127,33 @@ enum BoneSpaces {
 
 BEGIN_ASSET(Shader)
     GLuint program;
-    SDL_PropertiesID uniforms;
+    struct HashMap* uniforms; // Locations, offset by 1 so that 0 stays NULL
 END_ASSET(shaders, shader, Shader)
 
 BEGIN_ASSET(Texture)
     struct Texture* parent;
+    struct TextureJob* job; // Pending upload, "texture" is 0 until it's done
 
     GLuint texture;
     uint16_t size[2];
     vec2 offset;
     vec4 uvs;
+
+    // Streaming, "lod" is the top level that's resident
+    GLenum format;
+    uint8_t num_levels, lod, wanted_lod;
+    uint64_t stream_frame;
+    size_t vram;
+    char* cache_path; // NULL if it can't be streamed
+    bool resident;    // Always kept at full resolution
 END_ASSET(textures, texture, Texture)
 
+void set_texture_compression(bool);
+void set_texture_budget(size_t);
+void request_texture(struct Texture*, float);
+void update_textures(bool);
+bool finish_texture(struct Texture*);
+
 BEGIN_ASSET(Material)
     struct Texture** textures[2]; // (0) Base and (1) blend textures [u_texture, u_blend_texture]
     size_t num_textures[2];       // (0) Base and (1) blend texture count
@@ -129,6 +176,26 @@ struct Submodel {
     size_t num_vertices;
 
     size_t material;
+    vec3 bounds[2]; // (0) Minimum and (1) maximum
+};
+
+// Submodel merged into a batch, kept around for culling and hiding.
+struct ModelChunk {
+    size_t submodel;
+    GLint first;
+    GLsizei count;
+    vec3 bounds[2];
+};
+
+// Static geometry: opaque submodels sharing a material in one buffer, blended
+// ones alone in theirs.
+struct ModelBatch {
+    GLuint vao, vbo;
+    size_t num_vertices;
+
+    size_t material;
+    struct ModelChunk* chunks;
+    size_t num_chunks;
 };
 
 struct Node {
@@ -157,8 +224,13 @@ BEGIN_ASSET(Model)
     size_t num_materials;
 
     struct Texture* lightmap;
+
+    struct ModelBatch* batches;
+    size_t num_batches;
 END_ASSET(models, model, Model)
 
+void batch_model(struct Model*);
+
 void destroy_node(struct Node*);
 
 BEGIN_ASSET(Animation)
@@ -1,6 +1,7 @@
 #include "L_config.h"
 #include "L_file.h"
 #include "L_input.h"
+#include "L_internal.h"
 #include "L_localize.h"
 #include "L_log.h"
 #include "L_memory.h"
@@ -26,6 +27,14 @@ void config_init(const char* confpath, const char* contpath) {
     SDL_SetNumberProperty(default_cvars, "vid_fullscreen", FSM_WINDOWED);
     SDL_SetBooleanProperty(default_cvars, "vid_vsync", false);
     SDL_SetNumberProperty(default_cvars, "vid_maxfps", 60);
+    SDL_SetNumberProperty(default_cvars, "vid_background_maxfps", 15);
+    SDL_SetNumberProperty(default_cvars, "vid_frame_latency", 2);
+    SDL_SetBooleanProperty(default_cvars, "vid_depth_prepass", false);
+    SDL_SetBooleanProperty(default_cvars, "vid_gpu_interpolation", false);
+    SDL_SetBooleanProperty(default_cvars, "vid_texture_compression", false);
+    SDL_SetNumberProperty(default_cvars, "vid_texture_budget", 0);
+    SDL_SetBooleanProperty(default_cvars, "vid_present_thread", false);
+    SDL_SetBooleanProperty(default_cvars, "vid_render_stats", false);
 
     SDL_SetBooleanProperty(default_cvars, "in_invert_x", false);
     SDL_SetBooleanProperty(default_cvars, "in_invert_y", false);
@@ -34,6 +43,9 @@ void config_init(const char* confpath, const char* contpath) {
     SDL_SetFloatProperty(default_cvars, "in_mouse_x", 6);
     SDL_SetFloatProperty(default_cvars, "in_mouse_y", 6);
 
+    SDL_SetBooleanProperty(default_cvars, "snd_background_pause", false);
+    SDL_SetNumberProperty(default_cvars, "background_tickrate", 0);
+
     SDL_strlcpy(config_path, confpath == NULL ? get_pref_path("config.json") : confpath, sizeof(config_path));
     SDL_strlcpy(controls_path, contpath == NULL ? get_pref_path("controls.json") : contpath, sizeof(controls_path));
     INFO("\nConfig: %s\nControls: %s", config_path, controls_path);
@@ -135,6 +147,37 @@ void apply_cvar(const char* name) {
         set_framerate((int16_t)SDL_max(vid_maxfps, 0));
     }
 
+    if (name == NULL || SDL_strcmp(name, "vid_background_maxfps") == 0) {
+        Sint64 vid_background_maxfps = get_int_cvar("vid_background_maxfps");
+        set_background_framerate((int16_t)SDL_max(vid_background_maxfps, 0));
+    }
+
+    if (name == NULL || SDL_strcmp(name, "vid_frame_latency") == 0) {
+        Sint64 vid_frame_latency = get_int_cvar("vid_frame_latency");
+        set_frame_latency((uint8_t)SDL_clamp(vid_frame_latency, 0, MAX_FRAME_LATENCY));
+    }
+
+    if (name == NULL || SDL_strcmp(name, "vid_depth_prepass") == 0)
+        set_depth_prepass(get_bool_cvar("vid_depth_prepass"));
+
+    if (name == NULL || SDL_strcmp(name, "vid_gpu_interpolation") == 0)
+        set_gpu_interpolation(get_bool_cvar("vid_gpu_interpolation"));
+
+    if (name == NULL || SDL_strcmp(name, "vid_texture_compression") == 0)
+        set_texture_compression(get_bool_cvar("vid_texture_compression"));
+
+    if (name == NULL || SDL_strcmp(name, "vid_texture_budget") == 0)
+        set_texture_budget((size_t)SDL_max(get_int_cvar("vid_texture_budget"), 0) * 1048576); // Megabytes
+
+    if (name == NULL || SDL_strcmp(name, "vid_present_thread") == 0)
+        set_present_thread(get_bool_cvar("vid_present_thread"));
+
+    if (name == NULL || SDL_strcmp(name, "vid_render_stats") == 0)
+        set_render_stats_log(get_bool_cvar("vid_render_stats"));
+
+    if (name == NULL || SDL_strcmp(name, "snd_background_pause") == 0 || SDL_strcmp(name, "background_tickrate") == 0)
+        refresh_background();
+
     if (name == NULL || SDL_strcmp(name, "language") == 0)
         set_language(get_string_cvar("language"));
 }
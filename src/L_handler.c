@@ -82,7 +82,7 @@ int define_handler(lua_State* L) {
 
     // Register handler
     if (handler->on_register != LUA_NOREF)
-        execute_ref(handler->on_register, name);
+        execute_ref(handler->on_register, handler->name);
 
     return 0;
 }
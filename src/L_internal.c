@@ -18,6 +18,35 @@
 #include "L_video.h"
 
 static struct LoadState load_state = {0};
+static bool in_background = false;
+
+static void update_background() {
+    const bool minimized = window_is_minimized();
+    const bool background = minimized || !window_has_focus();
+    set_video_background(background, minimized);
+    if (in_background == background)
+        return;
+    in_background = background;
+
+    if (background) {
+        refresh_background();
+        INFO("Entered background");
+    } else {
+        // The CVars may have changed since entering, so always undo both
+        pause_world_sounds(ui_blocking());
+        set_tick_scale(1);
+        INFO("Left background");
+    }
+}
+
+void refresh_background() {
+    if (!in_background)
+        return;
+
+    pause_world_sounds(get_bool_cvar("snd_background_pause") || ui_blocking());
+    const Sint64 tickrate = get_int_cvar("background_tickrate");
+    set_tick_scale((tickrate > 0) ? ((float)tickrate / (float)TICKRATE) : 1);
+}
 
 void init(const char* config_path, const char* controls_path, bool bypass_shader) {
     log_init();
@@ -65,6 +94,13 @@ void loop() {
                     running = false;
                     break;
 
+                case SDL_EVENT_WINDOW_FOCUS_GAINED:
+                case SDL_EVENT_WINDOW_FOCUS_LOST:
+                case SDL_EVENT_WINDOW_MINIMIZED:
+                case SDL_EVENT_WINDOW_RESTORED:
+                    update_background();
+                    break;
+
                 case SDL_EVENT_KEYBOARD_ADDED:
                 case SDL_EVENT_KEYBOARD_REMOVED:
                     handle_keyboard(&event.kdevice);
@@ -104,6 +140,11 @@ void loop() {
         if (!running)
             break;
 
+        // Loading touches GL, reclaim the context from the present thread
+        if (load_state.state != LOAD_NONE)
+            video_sync();
+        set_alloc_phase((load_state.state != LOAD_NONE) ? AP_LOAD : AP_NONE);
+
         switch (load_state.state) {
             default:
                 break;
@@ -133,6 +174,8 @@ void loop() {
                 load_level(load_state.level, load_state.room, load_state.tag);
 
                 load_ui("Pause");
+                log_gpu_memory(); // Textures still uploading aren't counted yet
+                log_script_memory();
 
                 load_state.state = LOAD_END;
                 break;
@@ -164,16 +207,36 @@ void loop() {
 
         steam_update();
         input_update();
+        // Once a level is running, none of these should allocate
+        set_alloc_phase((load_state.state == LOAD_NONE) ? AP_TICK : AP_LOAD);
+        // The present thread keeps the context through the tick, GL work
+        // from it is deferred to video_update()
         tick_update();
+        set_alloc_phase((load_state.state == LOAD_NONE) ? AP_RENDER : AP_LOAD);
+        video_sync();
         video_update();
+        set_alloc_phase((load_state.state == LOAD_NONE) ? AP_AUDIO : AP_LOAD);
         audio_update();
+        set_alloc_phase(AP_NONE);
 
         if (load_state.state != LOAD_NONE && load_state.level[0] == '\0')
             running = false;
+
+        // Sleep until the next frame or tick is due
+        if (load_state.state == LOAD_NONE) {
+            const uint64_t next_frame = get_next_frame_time();
+            if (next_frame > 0) {
+                const uint64_t deadline = SDL_min(next_frame, get_next_tick_time());
+                const uint64_t now = SDL_GetTicksNS();
+                if (deadline > now)
+                    SDL_DelayPrecise(deadline - now);
+            }
+        }
     }
 }
 
 void cleanup() {
+    video_sync();
     unload_level();
     tick_teardown();
     handler_teardown();
@@ -194,6 +257,9 @@ void cleanup() {
     video_teardown();
     file_teardown();
     steam_teardown();
+    lame_frame_teardown();
+    atom_teardown();
+    dump_allocations();
     log_teardown();
     SDL_Quit();
 }
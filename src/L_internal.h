@@ -21,6 +21,7 @@ struct LoadState {
 void init(const char*, const char*, bool);
 void loop();
 void cleanup();
+void refresh_background();
 
 enum LoadStates get_load_state();
 void start_loading(const char*, uint32_t, uint16_t);
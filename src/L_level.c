@@ -10,24 +10,17 @@ void unload_level() {
     if (level == NULL)
         return;
 
-    for (size_t i = 0; level->rooms->count > 0 && i < level->rooms->capacity; i++) {
+    for (size_t i = 0; i < level->rooms->capacity; i++) {
         struct IKeyValuePair* kvp = &level->rooms->items[i];
-        if (kvp->state != IKVP_OCCUPIED)
-            continue;
-
-        struct Room* room = kvp->value;
-        if (room != NULL)
-            destroy_room(room);
-        kvp->value = NULL;
-        kvp->state = IKVP_DELETED;
-
-        level->rooms->count--;
+        if (kvp->state == IKVP_OCCUPIED && kvp->value != NULL)
+            destroy_room(kvp->value);
     }
-    destroy_int_map(level->rooms, true);
+    destroy_int_map(level->rooms, false);
 
-    lame_free(&(level->name));
-    lame_free(&(level->title));
-    lame_free(&level);
+    // Everything else went into the arena, including the level itself
+    DEBUG("Freeing level \"%s\" (%zu bytes)", level->name, level->arena->used);
+    destroy_arena(level->arena);
+    level = NULL;
 }
 
 void load_level(const char* name, uint32_t room, uint16_t tag) {
@@ -45,12 +38,14 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
     if (!yyjson_is_obj(root))
         FATAL("Expected level \"%s\" root as object, got %s", name, yyjson_get_type_desc(root));
 
-    level = lame_alloc_clean(sizeof(struct Level));
-    level->name = SDL_strdup(name);
+    struct Arena* arena = create_arena(LEVEL_ARENA_SIZE);
+    level = arena_alloc(arena, sizeof(struct Level));
+    level->arena = arena;
+    level->name = arena_strdup(arena, name);
 
     // Properties
     yyjson_val* value = yyjson_obj_get(root, "title");
-    level->title = SDL_strdup(yyjson_is_str(value) ? yyjson_get_str(value) : name);
+    level->title = arena_strdup(arena, yyjson_is_str(value) ? yyjson_get_str(value) : name);
 
     // Rooms
     level->rooms = create_int_map();
@@ -66,7 +61,7 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                 FATAL("Expected level \"%s\" room %u ID as uint, got %s", name, i, yyjson_get_type_desc(roomval));
 
             // Allocate room at this point
-            struct Room* room = lame_alloc_clean(sizeof(struct Room));
+            struct Room* room = arena_alloc(arena, sizeof(struct Room));
             room->level = level;
             room->id = (uint32_t)yyjson_get_uint(roomval);
             if (!to_int_map(level->rooms, room->id, room, false))
@@ -76,7 +71,6 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                 );
             room->userdata = create_pointer_ref("room", room);
 
-            room->bump.size[0] = room->bump.size[1] = 1;
             glm_vec4_one(room->ambient);
             room->fog_distance[0] = room->fog_distance[1] = 32000.0f;
             room->fog_color[3] = 1;
@@ -87,8 +81,10 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
             roomval = yyjson_obj_get(roomdef, "model");
             if (yyjson_is_str(roomval)) {
                 struct Model* model = fetch_model(yyjson_get_str(roomval));
-                if (model != NULL)
+                if (model != NULL) {
+                    batch_model(model);
                     room->model = create_model_instance(model);
+                }
             }
 
             roomval = yyjson_obj_get(roomdef, "ambient");
@@ -113,6 +109,10 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                 room->fog_color[3] = (float)yyjson_get_num(yyjson_arr_get(roomval, 3));
             }
 
+            roomval = yyjson_obj_get(roomdef, "depth_prepass");
+            if (yyjson_is_bool(roomval))
+                room->depth_prepass = yyjson_get_bool(roomval);
+
             roomval = yyjson_obj_get(roomdef, "wind");
             if (yyjson_is_arr(roomval) && yyjson_arr_size(roomval) >= 4) {
                 room->wind[0] = (float)yyjson_get_num(yyjson_arr_get(roomval, 0));
@@ -143,7 +143,7 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                     if (!load_actor(type))
                         continue;
 
-                    struct RoomActor* room_actor = lame_alloc_clean(sizeof(struct RoomActor));
+                    struct RoomActor* room_actor = arena_alloc(arena, sizeof(struct RoomActor));
                     room_actor->type = get_actor_type(type);
 
                     if (room->room_actors != NULL)
@@ -165,6 +165,8 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                         room_actor->flags |= RAF_PERSISTENT;
                     if (yyjson_get_bool(yyjson_obj_get(actdef, "disposable")))
                         room_actor->flags |= RAF_DISPOSABLE;
+                    if (yyjson_get_bool(yyjson_obj_get(actdef, "static")))
+                        room_actor->flags |= RAF_STATIC;
 
                     update_bump_map(&room->bump, room_actor->pos);
                 }
@@ -172,6 +174,11 @@ void load_level(const char* name, uint32_t room, uint16_t tag) {
                 WTF("Expected level \"%s\" room ID %u actors as array, got %s", name, room->id,
                     yyjson_get_type_desc(root));
             }
+
+            // Room actors are all in, so the bump map's bounds are final
+            if (room->bump.size[0] <= 0 || room->bump.size[1] <= 0)
+                room->bump.size[0] = room->bump.size[1] = 1;
+            room->bump.chunks = arena_alloc(arena, room->bump.size[0] * room->bump.size[1] * sizeof(struct Actor*));
         }
     } else {
         WTF("Expected level \"%s\" rooms as array, got %s", name, yyjson_get_type_desc(root));
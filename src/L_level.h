@@ -3,7 +3,10 @@
 #include "L_memory.h"
 #include "L_room.h" // IWYU pragma: keep
 
+#define LEVEL_ARENA_SIZE 65536 // Block size for level-lifetime allocations
+
 struct Level {
+    struct Arena* arena; // Owns the level, its rooms and room actors
     const char *name, *title;
     struct IntMap* rooms;
 };
@@ -136,3 +136,14 @@ void dq_slerp(const float a[8], const float b[8], float amount, float dest[8]) {
     dest[6] = (p2 * a3 + p0 * a1 - p1 * a0) * 0.5f;
     dest[7] = (-p0 * a0 - p1 * a1 - p2 * a2) * 0.5f;
 }
+
+void dq_to_mat4(const float dq[8], mat4 dest) {
+    float r0 = dq[0], r1 = dq[1], r2 = dq[2], r3 = dq[3];
+    // (* 2 since we use this only in the translation reconstruction)
+    float d4 = dq[4] * 2, d5 = dq[5] * 2, d6 = dq[6] * 2, d7 = dq[7] * 2;
+
+    glm_quat_mat4((versor){r0, r1, r2, r3}, dest);
+    dest[3][0] = d7 * (-r0) + d4 * r3 + d5 * (-r2) - d6 * (-r1);
+    dest[3][1] = d7 * (-r1) + d5 * r3 + d6 * (-r0) - d4 * (-r2);
+    dest[3][2] = d7 * (-r2) + d6 * r3 + d4 * (-r1) - d5 * (-r0);
+}
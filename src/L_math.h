@@ -35,3 +35,4 @@ void dq_copy(const float[8], float[8]);
 void dq_mul(const float[8], const float[8], float[8]);
 void dq_lerp(const float[8], const float[8], float, float[8]);
 void dq_slerp(const float[8], const float[8], float, float[8]);
+void dq_to_mat4(const float[8], mat4);
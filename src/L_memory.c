@@ -1,8 +1,301 @@
+#include <SDL3/SDL_atomic.h>
 #include <SDL3/SDL_endian.h>
+#include <SDL3/SDL_thread.h>
 
 #include "L_log.h"
 #include "L_memory.h"
 
+static enum AllocPhases alloc_phase = AP_NONE;
+static const char* alloc_phase_names[AP_SIZE] = {"none", "tick", "render", "audio", "load"};
+
+#ifdef LAME_TRACK_ALLOCATIONS
+struct AllocSite {
+    const char* filename; // Only compared for Lua sites, which print their label instead
+    int line;
+    size_t live_bytes, live_count, total_bytes, total_count;
+    size_t phase_count[AP_SIZE];
+    char label[ALLOC_LABEL_MAX];
+};
+
+struct AllocRecord {
+    void* ptr;
+    size_t size;
+    struct AllocSite* site;
+};
+
+// The texture loader allocates too, so everything below is behind a lock
+static SDL_SpinLock alloc_lock = 0;
+
+static struct AllocSite alloc_sites[ALLOC_SITES_MAX] = {0};
+static struct AllocSite overflow_site = {"(other)", 0, 0, 0, 0, 0, {0}, ""};
+static size_t num_alloc_sites = 0;
+
+// Live allocations by pointer, open addressing with a power-of-two capacity
+static struct AllocRecord* alloc_records = NULL;
+static size_t num_alloc_records = 0, alloc_records_capacity = 0;
+
+static size_t live_bytes = 0, peak_bytes = 0;
+static size_t tick_allocs = 0, tick_bytes = 0, peak_tick_allocs = 0, peak_tick_bytes = 0;
+static uint64_t num_ticks = 0, ticked_allocs = 0;
+
+// Phases only apply to the thread that set them
+static SDL_ThreadID alloc_phase_thread = 0;
+static size_t phase_allocs[AP_SIZE] = {0};
+
+static size_t hash_alloc_pointer(const void* ptr) {
+    return (size_t)(((uint64_t)(uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ULL);
+}
+
+static struct AllocSite* get_alloc_site(const char* filename, int line) {
+    size_t i = ((((uintptr_t)filename >> 3) ^ ((size_t)line * 2654435761u))) % ALLOC_SITES_MAX;
+    for (size_t j = 0; j < ALLOC_SITES_MAX; j++) {
+        struct AllocSite* site = &alloc_sites[i];
+        if (site->filename == NULL) {
+            // Keep a few slots free so probing stays short
+            if (num_alloc_sites >= (ALLOC_SITES_MAX * 3 / 4))
+                return &overflow_site;
+            site->filename = filename;
+            site->line = line;
+            num_alloc_sites++;
+            return site;
+        }
+        if (site->filename == filename && site->line == line)
+            return site;
+        i = (i + 1) % ALLOC_SITES_MAX;
+    }
+    return &overflow_site;
+}
+
+static const char* alloc_site_name(const struct AllocSite* site) {
+    return (site->label[0] != '\0') ? site->label : src_basename(site->filename);
+}
+
+// Filled in under the lock, logged after it's released so other threads don't spin on the log write
+struct AllocWarning {
+    bool pending;
+    enum AllocPhases phase;
+    size_t size;
+    char name[ALLOC_LABEL_MAX];
+    int line;
+};
+
+static void check_alloc_phase(struct AllocSite* site, size_t size, struct AllocWarning* warning) {
+    if (alloc_phase == AP_NONE || alloc_phase == AP_LOAD || SDL_GetCurrentThreadID() != alloc_phase_thread)
+        return;
+
+    phase_allocs[alloc_phase]++;
+    if (site->phase_count[alloc_phase]++ == 0) {
+        warning->pending = true;
+        warning->phase = alloc_phase;
+        warning->size = size;
+        SDL_strlcpy(warning->name, alloc_site_name(site), sizeof(warning->name));
+        warning->line = site->line;
+    }
+}
+
+static void log_alloc_warning(const struct AllocWarning* warning) {
+    if (warning->pending)
+        WARN(
+            "Allocated %zu bytes during %s at %s:%d", warning->size, alloc_phase_names[warning->phase], warning->name,
+            warning->line
+        );
+}
+
+static void insert_alloc_record(struct AllocRecord record) {
+    const size_t mask = alloc_records_capacity - 1;
+    size_t i = hash_alloc_pointer(record.ptr) & mask;
+    while (alloc_records[i].ptr != NULL)
+        i = (i + 1) & mask;
+    alloc_records[i] = record;
+}
+
+static void track_alloc(void* ptr, size_t size, const char* filename, int line) {
+    struct AllocWarning warning = {0};
+    SDL_LockSpinlock(&alloc_lock);
+
+    if ((num_alloc_records + 1) * 4 >= alloc_records_capacity * 3) {
+        struct AllocRecord* old = alloc_records;
+        const size_t old_capacity = alloc_records_capacity;
+        alloc_records_capacity = (old_capacity > 0) ? (old_capacity * 2) : 1024;
+        alloc_records = SDL_calloc(alloc_records_capacity, sizeof(struct AllocRecord));
+        if (alloc_records == NULL)
+            log_fatal(src_basename(filename), line, "Allocation tracking ran out of memory");
+        for (size_t i = 0; i < old_capacity; i++)
+            if (old[i].ptr != NULL)
+                insert_alloc_record(old[i]);
+        SDL_free(old);
+    }
+
+    struct AllocSite* site = get_alloc_site(filename, line);
+    site->live_bytes += size;
+    site->live_count++;
+    site->total_bytes += size;
+    site->total_count++;
+    check_alloc_phase(site, size, &warning);
+
+    insert_alloc_record((struct AllocRecord){ptr, size, site});
+    num_alloc_records++;
+
+    live_bytes += size;
+    peak_bytes = SDL_max(peak_bytes, live_bytes);
+    tick_allocs++;
+    tick_bytes += size;
+
+    SDL_UnlockSpinlock(&alloc_lock);
+    log_alloc_warning(&warning);
+}
+
+static void untrack_alloc(void* ptr) {
+    SDL_LockSpinlock(&alloc_lock);
+    if (alloc_records_capacity <= 0) {
+        SDL_UnlockSpinlock(&alloc_lock);
+        return;
+    }
+
+    const size_t mask = alloc_records_capacity - 1;
+    size_t i = hash_alloc_pointer(ptr) & mask;
+    while (alloc_records[i].ptr != NULL && alloc_records[i].ptr != ptr)
+        i = (i + 1) & mask;
+
+    // Not ours (e.g. from SDL_strdup), nothing to do
+    if (alloc_records[i].ptr == NULL) {
+        SDL_UnlockSpinlock(&alloc_lock);
+        return;
+    }
+
+    struct AllocRecord* record = &alloc_records[i];
+    record->site->live_bytes -= record->size;
+    record->site->live_count--;
+    live_bytes -= record->size;
+    num_alloc_records--;
+
+    // Backward shift deletion, so no tombstones
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (alloc_records[j].ptr == NULL)
+            break;
+        const size_t home = hash_alloc_pointer(alloc_records[j].ptr) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            alloc_records[i] = alloc_records[j];
+            i = j;
+        }
+    }
+    alloc_records[i].ptr = NULL;
+
+    SDL_UnlockSpinlock(&alloc_lock);
+}
+
+void tick_allocations() {
+    SDL_LockSpinlock(&alloc_lock);
+    peak_tick_allocs = SDL_max(peak_tick_allocs, tick_allocs);
+    peak_tick_bytes = SDL_max(peak_tick_bytes, tick_bytes);
+    ticked_allocs += tick_allocs;
+    num_ticks++;
+    tick_allocs = tick_bytes = 0;
+    SDL_UnlockSpinlock(&alloc_lock);
+}
+
+// Lua allocations are keyed by the callback running them, they aren't tracked per pointer
+void track_script_alloc(const void* source, const char* label, int line, size_t size) {
+    struct AllocWarning warning = {0};
+    SDL_LockSpinlock(&alloc_lock);
+    struct AllocSite* site = get_alloc_site((const char*)source, line);
+    if (site != &overflow_site && site->label[0] == '\0')
+        SDL_strlcpy(site->label, label, sizeof(site->label));
+    site->total_bytes += size;
+    site->total_count++;
+    check_alloc_phase(site, size, &warning);
+    SDL_UnlockSpinlock(&alloc_lock);
+    log_alloc_warning(&warning);
+}
+
+static int compare_alloc_sites(const void* a, const void* b) {
+    const struct AllocSite* site_a = (const struct AllocSite*)a;
+    const struct AllocSite* site_b = (const struct AllocSite*)b;
+    if (site_a->live_bytes != site_b->live_bytes)
+        return (site_a->live_bytes < site_b->live_bytes) ? 1 : -1;
+    if (site_a->total_count != site_b->total_count)
+        return (site_a->total_count < site_b->total_count) ? 1 : -1;
+    return 0;
+}
+
+void dump_allocations() {
+    // Snapshot everything under the lock, then sort and log without holding it
+    SDL_LockSpinlock(&alloc_lock);
+    const size_t snap_live_bytes = live_bytes, snap_records = num_alloc_records, snap_peak_bytes = peak_bytes;
+    const size_t snap_peak_tick_allocs = peak_tick_allocs, snap_peak_tick_bytes = peak_tick_bytes;
+    const double tick_average = (num_ticks > 0) ? ((double)ticked_allocs / (double)num_ticks) : 0.0;
+    size_t snap_phase_allocs[AP_SIZE];
+    SDL_memcpy(snap_phase_allocs, phase_allocs, sizeof(phase_allocs));
+
+    // Not lame_alloc, that would track itself
+    struct AllocSite* sites = SDL_malloc((num_alloc_sites + 1) * sizeof(struct AllocSite));
+    size_t n = 0;
+    if (sites != NULL) {
+        for (size_t i = 0; i < ALLOC_SITES_MAX; i++)
+            if (alloc_sites[i].filename != NULL)
+                sites[n++] = alloc_sites[i];
+        if (overflow_site.total_count > 0)
+            sites[n++] = overflow_site;
+    }
+    SDL_UnlockSpinlock(&alloc_lock);
+
+    INFO(
+        "Allocations: %zu bytes live in %zu blocks, peaked at %zu bytes", snap_live_bytes, snap_records,
+        snap_peak_bytes
+    );
+    INFO(
+        "Allocations per tick: %.2f average, %zu peak (%zu bytes)", tick_average, snap_peak_tick_allocs,
+        snap_peak_tick_bytes
+    );
+    INFO(
+        "Steady-state allocations: %zu during tick, %zu during render, %zu during audio", snap_phase_allocs[AP_TICK],
+        snap_phase_allocs[AP_RENDER], snap_phase_allocs[AP_AUDIO]
+    );
+    if (sites == NULL) {
+        WARN("Not enough memory to list call sites");
+        return;
+    }
+
+    // Live sites first (likely leaks on exit), then the busiest ones
+    SDL_qsort(sites, n, sizeof(struct AllocSite), compare_alloc_sites);
+    for (size_t i = 0; i < SDL_min(n, ALLOC_REPORT_SITES); i++) {
+        const struct AllocSite* site = &sites[i];
+        INFO(
+            "%s:%d: %zu live (%zu bytes), %zu total (%zu bytes)", alloc_site_name(site), site->line,
+            site->live_count, site->live_bytes, site->total_count, site->total_bytes
+        );
+    }
+    if (n > ALLOC_REPORT_SITES)
+        INFO("... and %zu more call sites", n - ALLOC_REPORT_SITES);
+
+    SDL_free(sites);
+}
+#else
+#define track_alloc(ptr, size, filename, line)
+#define untrack_alloc(ptr)
+#endif
+
+void set_alloc_phase(enum AllocPhases phase) {
+#ifdef LAME_TRACK_ALLOCATIONS
+    SDL_LockSpinlock(&alloc_lock);
+    alloc_phase = phase;
+    alloc_phase_thread = SDL_GetCurrentThreadID();
+    SDL_UnlockSpinlock(&alloc_lock);
+#else
+    alloc_phase = phase;
+#endif
+}
+
+enum AllocPhases get_alloc_phase() {
+    return alloc_phase;
+}
+
+const char* get_alloc_phase_name(enum AllocPhases phase) {
+    return (phase >= 0 && phase < AP_SIZE) ? alloc_phase_names[phase] : "?";
+}
+
 void* _lame_alloc(size_t size, const char* filename, int line) {
     if (!size)
         log_fatal(src_basename(filename), line, "Allocating 0 bytes?");
@@ -10,6 +303,7 @@ void* _lame_alloc(size_t size, const char* filename, int line) {
     void* ptr = SDL_malloc(size);
     if (ptr == NULL)
         log_fatal(src_basename(filename), line, "Allocation failed");
+    track_alloc(ptr, size, filename, line);
     return ptr;
 }
 
@@ -22,6 +316,7 @@ void* _lame_alloc_clean(size_t size, const char* filename, int line) {
 void _lame_free(void** ptr, const char* filename, int line) {
     if (ptr == NULL || *ptr == NULL)
         log_fatal(src_basename(filename), line, "Freeing a null pointer?");
+    untrack_alloc(*ptr);
     SDL_free(*ptr);
     *ptr = NULL;
 }
@@ -38,9 +333,11 @@ void _lame_realloc(void** ptr, size_t size, const char* filename, int line) {
     if (size <= 0)
         log_fatal(src_basename(filename), line, "Reallocating to 0 bytes?");
 
+    untrack_alloc(*ptr);
     *ptr = SDL_realloc(*ptr, size);
     if (*ptr == NULL)
         log_fatal(src_basename(filename), line, "Reallocation failed");
+    track_alloc(*ptr, size, filename, line);
 }
 
 void _lame_realloc_clean(void** ptr, size_t old_size, size_t new_size, const char* filename, int line) {
@@ -57,87 +354,349 @@ void _lame_set(void* dest, char val, size_t size, const char* filename, int line
     SDL_memset(dest, val, size);
 }
 
-uint8_t read_u8(uint8_t** buf) {
-    uint8_t result = **buf;
-    *buf += sizeof(uint8_t);
+struct FrameBlock {
+    struct FrameBlock* next;
+    size_t size, used;
+    uint8_t* data;
+};
+
+// Keep the data aligned after the block header
+#define FRAME_BLOCK_HEADER ((sizeof(struct FrameBlock) + FRAME_ARENA_ALIGN - 1) & ~(size_t)(FRAME_ARENA_ALIGN - 1))
+
+static struct FrameBlock *frame_head = NULL, *frame_tail = NULL;
+static size_t frame_used = 0, frame_peak = 0;
+
+static struct FrameBlock* create_frame_block(size_t size, const char* filename, int line) {
+    struct FrameBlock* block = _lame_alloc(FRAME_BLOCK_HEADER + size, filename, line);
+    block->next = NULL;
+    block->data = (uint8_t*)block + FRAME_BLOCK_HEADER;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+static void destroy_frame_blocks() {
+    struct FrameBlock* block = frame_head;
+    while (block != NULL) {
+        struct FrameBlock* next = block->next;
+        lame_free(&block);
+        block = next;
+    }
+    frame_head = frame_tail = NULL;
+}
+
+void* _lame_frame_alloc(size_t size, const char* filename, int line) {
+    if (!size)
+        log_fatal(src_basename(filename), line, "Allocating 0 bytes?");
+    size = (size + FRAME_ARENA_ALIGN - 1) & ~(size_t)(FRAME_ARENA_ALIGN - 1);
+
+    if (frame_tail == NULL)
+        frame_head = frame_tail = create_frame_block(SDL_max(size, FRAME_ARENA_SIZE), filename, line);
+    else if (frame_tail->size - frame_tail->used < size) {
+        if (frame_tail->next != NULL && frame_tail->next->size >= size) {
+            // Reuse a block emptied by lame_frame_release()
+            frame_tail = frame_tail->next;
+        } else {
+            // Out of room, chain another block until the next reset merges them
+            struct FrameBlock* block = create_frame_block(SDL_max(size, frame_tail->size), filename, line);
+            block->next = frame_tail->next;
+            frame_tail->next = block;
+            frame_tail = block;
+            DEBUG("Frame arena overflowed at %zu bytes (%s:%d)", frame_used, src_basename(filename), line);
+        }
+    }
+
+    void* ptr = frame_tail->data + frame_tail->used;
+    frame_tail->used += size;
+    frame_used += size;
+    frame_peak = SDL_max(frame_peak, frame_used);
+    return ptr;
+}
+
+void lame_frame_reset() {
+    if (frame_head != NULL && frame_head->next != NULL) {
+        destroy_frame_blocks();
+        frame_head = frame_tail = create_frame_block(frame_peak, __FILE__, __LINE__);
+    } else if (frame_head != NULL) {
+        frame_head->used = 0;
+    }
+    frame_used = 0;
+}
+
+struct FrameMark lame_frame_mark() {
+    return (struct FrameMark){frame_tail, (frame_tail != NULL) ? frame_tail->used : 0, frame_used};
+}
+
+// Frees everything allocated since the mark, blocks chained after it stay around for reuse
+void lame_frame_release(struct FrameMark mark) {
+    struct FrameBlock* block = (mark.block != NULL) ? mark.block : frame_head;
+    if (block == NULL)
+        return;
+
+    for (struct FrameBlock* it = block->next; it != NULL; it = it->next)
+        it->used = 0;
+    block->used = mark.block_used;
+    frame_tail = block;
+    frame_used = mark.used;
+}
+
+void lame_frame_teardown() {
+    if (frame_head != NULL)
+        INFO("Frame arena peaked at %zu bytes", frame_peak);
+    destroy_frame_blocks();
+    frame_used = frame_peak = 0;
+}
+
+size_t lame_frame_used() {
+    return frame_used;
+}
+
+size_t lame_frame_peak() {
+    return frame_peak;
+}
+
+struct Arena* _create_arena(size_t block_size, const char* filename, int line) {
+    if (!block_size)
+        log_fatal(src_basename(filename), line, "Creating an empty arena?");
+
+    struct Arena* arena = _lame_alloc_clean(sizeof(struct Arena), filename, line);
+    arena->block_size = block_size;
+    return arena;
+}
+
+void _destroy_arena(struct Arena* arena, const char* filename, int line) {
+    struct ArenaBlock* block = arena->blocks;
+    while (block != NULL) {
+        struct ArenaBlock* next = block->next;
+        _lame_free((void**)&block, filename, line);
+        block = next;
+    }
+    _lame_free((void**)&arena, filename, line);
+}
+
+void* _arena_alloc(struct Arena* arena, size_t size, const char* filename, int line) {
+    if (!size)
+        log_fatal(src_basename(filename), line, "Allocating 0 bytes?");
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    struct ArenaBlock* block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        const size_t block_size = SDL_max(size, arena->block_size);
+        const size_t header = (sizeof(struct ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        block = _lame_alloc(header + block_size, filename, line);
+        block->data = (uint8_t*)block + header;
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    SDL_memset(ptr, 0, size);
+    return ptr;
+}
+
+char* _arena_strdup(struct Arena* arena, const char* str, const char* filename, int line) {
+    const size_t size = SDL_strlen(str) + 1;
+    return _lame_copy(_arena_alloc(arena, size, filename, line), str, size, filename, line);
+}
+
+struct Pool* _create_pool(const char* name, size_t item_size, size_t slab_size, const char* filename, int line) {
+    if (!item_size || !slab_size)
+        log_fatal(src_basename(filename), line, "Creating an empty pool?");
+
+    struct Pool* pool = _lame_alloc_clean(sizeof(struct Pool), filename, line);
+    pool->name = name;
+    // Items double as free list links while unused
+    item_size = SDL_max(item_size, sizeof(void*));
+    pool->item_size = (item_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->slab_size = slab_size;
+    return pool;
+}
+
+void _destroy_pool(struct Pool* pool, const char* filename, int line) {
+    if (pool->count > 0)
+        WARN("Pool \"%s\" destroyed with %zu live items", pool->name, pool->count);
+
+    struct PoolSlab* slab = pool->slabs;
+    while (slab != NULL) {
+        struct PoolSlab* next = slab->next;
+        _lame_free((void**)&slab->items, filename, line);
+        _lame_free((void**)&slab, filename, line);
+        slab = next;
+    }
+    _lame_free((void**)&pool, filename, line);
+}
+
+void* _pool_alloc(struct Pool* pool, const char* filename, int line) {
+    if (pool->free_list == NULL) {
+        struct PoolSlab* slab = _lame_alloc(sizeof(struct PoolSlab), filename, line);
+        slab->items = _lame_alloc(pool->slab_size * pool->item_size, filename, line);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->capacity += pool->slab_size;
+
+        // Thread the new items onto the free list back to front so they come out in order
+        for (size_t i = pool->slab_size; i-- > 0;) {
+            void** item = (void**)(slab->items + (i * pool->item_size));
+            *item = pool->free_list;
+            pool->free_list = item;
+        }
+    }
+
+    void** item = pool->free_list;
+    pool->free_list = *item;
+    pool->count++;
+    SDL_memset(item, 0, pool->item_size);
+    return item;
+}
+
+void _pool_free(struct Pool* pool, void** ptr, const char* filename, int line) {
+    if (ptr == NULL || *ptr == NULL)
+        log_fatal(src_basename(filename), line, "Freeing a null pointer from pool \"%s\"?", pool->name);
+
+    void** item = *ptr;
+    *item = pool->free_list;
+    pool->free_list = item;
+    pool->count--;
+    *ptr = NULL;
+}
+
+// Copies the next bytes out, or zeroes the destination if there aren't enough left
+static bool read_into(struct BinaryReader* reader, void* dest, size_t size) {
+    if ((size_t)(reader->end - reader->ptr) < size) {
+        reader->ptr = reader->end;
+        reader->overflow = true;
+        SDL_memset(dest, 0, size);
+        return false;
+    }
+
+    SDL_memcpy(dest, reader->ptr, size);
+    reader->ptr += size;
+    return true;
+}
+
+size_t reader_remaining(const struct BinaryReader* reader) {
+    return (size_t)(reader->end - reader->ptr);
+}
+
+// Skips past a null-terminated magic string if the buffer starts with it
+bool read_magic(struct BinaryReader* reader, const char* magic) {
+    const size_t size = SDL_strlen(magic) + 1;
+    if (reader_remaining(reader) < size || SDL_memcmp(reader->ptr, magic, size) != 0)
+        return false;
+    reader->ptr += size;
+    return true;
+}
+
+void skip_bytes(struct BinaryReader* reader, size_t size) {
+    if (reader_remaining(reader) < size) {
+        reader->ptr = reader->end;
+        reader->overflow = true;
+        return;
+    }
+    reader->ptr += size;
+}
+
+uint8_t read_u8(struct BinaryReader* reader) {
+    uint8_t result;
+    read_into(reader, &result, sizeof(uint8_t));
     return result;
 }
 
-uint16_t _read_u16(uint8_t** buf, const char* filename, int line) {
+uint16_t read_u16(struct BinaryReader* reader) {
     uint16_t result;
-    _lame_copy(&result, *buf, sizeof(uint16_t), filename, line);
-    *buf += sizeof(uint16_t);
+    read_into(reader, &result, sizeof(uint16_t));
     return SDL_Swap16LE(result);
 }
 
-uint32_t _read_u32(uint8_t** buf, const char* filename, int line) {
+uint32_t read_u32(struct BinaryReader* reader) {
     uint32_t result;
-    _lame_copy(&result, *buf, sizeof(uint32_t), filename, line);
-    *buf += sizeof(uint32_t);
+    read_into(reader, &result, sizeof(uint32_t));
     return SDL_Swap32LE(result);
 }
 
-uint64_t _read_u64(uint8_t** buf, const char* filename, int line) {
+uint64_t read_u64(struct BinaryReader* reader) {
     uint64_t result;
-    _lame_copy(&result, *buf, sizeof(uint64_t), filename, line);
-    *buf += sizeof(uint64_t);
+    read_into(reader, &result, sizeof(uint64_t));
     return SDL_Swap64LE(result);
 }
 
-int8_t read_s8(uint8_t** buf) {
-    int8_t result = *(int8_t*)(*buf);
-    *buf += sizeof(int8_t);
-    return result;
+int8_t read_s8(struct BinaryReader* reader) {
+    return (int8_t)read_u8(reader);
 }
 
-int16_t _read_s16(uint8_t** buf, const char* filename, int line) {
-    int16_t result;
-    _lame_copy(&result, *buf, sizeof(int16_t), filename, line);
-    *buf += sizeof(int16_t);
-    return SDL_Swap16LE(result);
+int16_t read_s16(struct BinaryReader* reader) {
+    return (int16_t)read_u16(reader);
 }
 
-int32_t _read_s32(uint8_t** buf, const char* filename, int line) {
-    int32_t result;
-    _lame_copy(&result, *buf, sizeof(int32_t), filename, line);
-    *buf += sizeof(int32_t);
-    return SDL_Swap32LE(result);
+int32_t read_s32(struct BinaryReader* reader) {
+    return (int32_t)read_u32(reader);
 }
 
-int64_t _read_s64(uint8_t** buf, const char* filename, int line) {
-    int64_t result;
-    _lame_copy(&result, *buf, sizeof(int64_t), filename, line);
-    *buf += sizeof(int64_t);
-    return SDL_Swap64LE(result);
+int64_t read_s64(struct BinaryReader* reader) {
+    return (int64_t)read_u64(reader);
 }
 
-float _read_f32(uint8_t** buf, const char* filename, int line) {
+float read_f32(struct BinaryReader* reader) {
     float result;
-    _lame_copy(&result, *buf, sizeof(float), filename, line);
-    *buf += sizeof(float);
+    read_into(reader, &result, sizeof(float));
     return SDL_SwapFloatLE(result);
 }
 
-double _read_f64(uint8_t** buf, const char* filename, int line) {
+double read_f64(struct BinaryReader* reader) {
+    const uint64_t bits = read_u64(reader);
     double result;
-    _lame_copy(&result, *buf, sizeof(double), filename, line);
-    *buf += sizeof(double);
-    return SDL_Swap64LE(result);
+    SDL_memcpy(&result, &bits, sizeof(double));
+    return result;
 }
 
-char* read_string(uint8_t** buf) {
-    uint8_t* cursor = *buf;
-    while (read_u8(&cursor) != '\0') {}
-    char* str = SDL_strndup((const char*)(*buf), (cursor - *buf) - 1);
-    *buf = cursor;
+char* read_string(struct BinaryReader* reader) {
+    const size_t length = SDL_strnlen((const char*)(reader->ptr), reader_remaining(reader));
+    if (length >= reader_remaining(reader)) {
+        reader->ptr = reader->end;
+        reader->overflow = true;
+        return SDL_strdup("");
+    }
 
+    char* str = SDL_strndup((const char*)(reader->ptr), length);
+    reader->ptr += length + 1;
     return str;
 }
 
+void read_u8_array(struct BinaryReader* reader, uint8_t* dest, size_t count) {
+    read_into(reader, dest, count * sizeof(uint8_t));
+}
+
+void read_f32_array(struct BinaryReader* reader, float* dest, size_t count) {
+    if (!read_into(reader, dest, count * sizeof(float)))
+        return;
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    for (size_t i = 0; i < count; i++)
+        dest[i] = SDL_SwapFloatLE(dest[i]);
+#endif
+}
+
+// Chains handles [from, to) onto the end of the free list
+static void free_handles(struct Fixture* fixture, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        fixture->handles[i].next_free = HID_LIMIT;
+        if (fixture->last_free == HID_LIMIT)
+            fixture->first_free = (HID_HALF)i;
+        else
+            fixture->handles[fixture->last_free].next_free = (HID_HALF)i;
+        fixture->last_free = (HID_HALF)i;
+    }
+}
+
 struct Fixture* _create_fixture(const char* filename, int line) {
     struct Fixture* fixture = _lame_alloc_clean(sizeof(struct Fixture), filename, line);
     fixture->handles = _lame_alloc_clean(sizeof(struct Handle), filename, line);
     fixture->capacity = 1;
+    fixture->first_free = fixture->last_free = HID_LIMIT;
+    free_handles(fixture, 0, 1);
     return fixture;
 }
 
@@ -153,46 +712,42 @@ HandleID _create_handle(struct Fixture* fixture, void* ptr, const char* filename
         return 0;
     }
     if (fixture->size >= HID_LIMIT)
-        log_fatal(src_basename(filename), line, "!!! Out of handles (%u >= %u)", fixture->size, HID_LIMIT);
-
-    // Expand handles array on demand
-    size_t old_capacity = fixture->capacity;
-    if (fixture->next >= old_capacity) {
-        size_t new_capacity = fixture->capacity * 2;
-        if (new_capacity <= old_capacity)
-            log_fatal(
-                src_basename(filename), line, "!!! Out of handle capacity (%u <= %u)", new_capacity, old_capacity
-            );
+        log_fatal(
+            src_basename(filename), line, "!!! Out of handles (%zu >= %" SDL_PRIu64 ")", fixture->size,
+            (uint64_t)HID_LIMIT
+        );
 
+    // Expand handles array on demand, index HID_LIMIT marks the end of the free list
+    if (fixture->first_free == HID_LIMIT) {
+        size_t old_capacity = fixture->capacity;
+        size_t new_capacity = SDL_min(old_capacity * 2, (size_t)HID_LIMIT);
         _lame_realloc_clean(
             (void**)&fixture->handles, old_capacity * sizeof(struct Handle), new_capacity * sizeof(struct Handle),
             filename, line
         );
         fixture->capacity = new_capacity;
+        free_handles(fixture, old_capacity, new_capacity);
     }
 
-    // (Re)occupy an invalid handle
-    size_t index = fixture->next;
+    // (Re)occupy the oldest invalid handle
+    size_t index = fixture->first_free;
     struct Handle* handle = &fixture->handles[index];
+    fixture->first_free = handle->next_free;
+    if (fixture->first_free == HID_LIMIT)
+        fixture->last_free = HID_LIMIT;
+
     handle->ptr = ptr;
     if (++handle->generation <= 0) {
         log_generic(
             src_basename(filename), line,
-            "! %u handle index %u generation wrapped, expect undefined behavior from stale handle IDs", fixture, index
+            "! %p handle index %zu generation wrapped, expect undefined behavior from stale handle IDs", fixture, index
         );
         handle->generation = 1;
     }
     ++fixture->size;
 
-    // Find next invalid handle
-    while (1) {
-        ++fixture->next;
-        if (fixture->next >= fixture->capacity || fixture->handles[fixture->next].ptr == NULL)
-            break;
-    }
-
     // Generate handle ID
-    HandleID hid = ((HID_HALF)index << HID_BITS) | (HID_HALF)handle->generation;
+    HandleID hid = ((HandleID)index << HID_BITS) | (HID_HALF)handle->generation;
     return hid;
 }
 
@@ -201,24 +756,17 @@ void _destroy_handle(struct Fixture* fixture, HandleID hid, const char* filename
     HID_HALF generation = (HID_HALF)(hid & HID_LIMIT);
 
     // Sanity check
-    if (index >= fixture->capacity) {
+    struct Handle* handle = (index < fixture->capacity) ? &fixture->handles[index] : NULL;
+    if (handle == NULL || handle->ptr == NULL || handle->generation != generation) {
         log_generic(
-            src_basename(filename), line, "!! %u destroying invalid handle %u (%u/%u)?", fixture, hid, index, generation
-        );
-        return;
-    }
-
-    struct Handle* handle = &fixture->handles[index];
-    if (handle->ptr == NULL || handle->generation != generation) {
-        log_generic(
-            src_basename(filename), line, "!! %u destroying invalid handle %u (%u/%u)?", fixture, hid, index, generation
+            src_basename(filename), line, "!! %p destroying invalid handle %" SDL_PRIu64 " (%zu/%" SDL_PRIu64 ")?",
+            fixture, (uint64_t)hid, index, (uint64_t)generation
         );
         return;
     }
 
     handle->ptr = NULL;
-    if (index < fixture->next)
-        fixture->next = index;
+    free_handles(fixture, index, index + 1);
     --fixture->size;
 }
 
@@ -246,22 +794,118 @@ void* hid_to_pointer(struct Fixture* fixture, HandleID hid) {
     return (handle->generation != generation) ? NULL : handle->ptr; // God-knows-what
 }
 
+// Resolves handle IDs into pointers (NULL if stale), returns how many are still valid
+size_t hids_to_pointers(struct Fixture* fixture, const HandleID* hids, void** ptrs, size_t count) {
+    const struct Handle* handles = fixture->handles;
+    const size_t capacity = fixture->capacity;
+    size_t valid = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (size_t)(hids[i] >> HID_BITS);
+        HID_HALF generation = (HID_HALF)(hids[i] & HID_LIMIT);
+        void* ptr = (index < capacity && handles[index].generation == generation) ? handles[index].ptr : NULL;
+        ptrs[i] = ptr;
+        valid += ptr != NULL;
+    }
+
+    return valid;
+}
+
 // Abstract hash maps
 // You can either free values manually or nuke them alongside the maps.
+// Both kinds use Robin Hood probing on power-of-two tables: an entry that's
+// further from its home slot takes over from closer ones, which keeps probes
+// short and lets misses stop early. Popping shifts the rest of the cluster
+// back instead of leaving tombstones.
 // https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function
-#define HASH_CAPACITY 2
+#define HASH_CAPACITY 8
+#define HASH_LOAD(capacity) (((capacity) >> 1) + ((capacity) >> 2)) // 75%
 #define FNV_OFFSET 0x811c9dc5
 #define FNV_PRIME 0x01000193
 
+#define PROBE_DISTANCE(hash, index, mask) (((index) - ((size_t)(hash) & (mask))) & (mask))
+
+// Masking only keeps the low bits, so mix the high ones in first
+// https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp (fmix32)
+static uint32_t int_hash_key(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
 static uint32_t hash_key(const char* key) {
     uint32_t hash = FNV_OFFSET;
     for (const char* p = key; *p; p++) {
         hash ^= (uint32_t)(unsigned char)(*p);
         hash *= FNV_PRIME;
     }
-    return hash;
+    return int_hash_key(hash);
+}
+
+static size_t find_hash_map(const struct HashMap*, const char*, uint32_t);
+static void place_hash_map(struct KeyValuePair*, size_t, struct KeyValuePair);
+static void expand_hash_map(struct HashMap*, const char*, int);
+
+// Atoms live in a table of their own, stored right after their hash
+struct AtomHeader {
+    uint32_t hash;
+};
+
+static struct HashMap atoms = {NULL, 0, 0};
+
+Atom _intern(const char* str, const char* filename, int line) {
+    if (atoms.items == NULL) {
+        atoms.capacity = HASH_CAPACITY;
+        atoms.items = _lame_alloc_clean(HASH_CAPACITY * sizeof(struct KeyValuePair), filename, line);
+    }
+
+    const uint32_t hash = hash_key(str);
+    const size_t index = find_hash_map(&atoms, str, hash);
+    if (index < atoms.capacity)
+        return atoms.items[index].key;
+
+    const size_t size = SDL_strlen(str) + 1;
+    struct AtomHeader* header = _lame_alloc(sizeof(struct AtomHeader) + size, filename, line);
+    header->hash = hash;
+    char* atom = (char*)(header + 1);
+    SDL_memcpy(atom, str, size);
+
+    if (atoms.count + 1 > HASH_LOAD(atoms.capacity))
+        expand_hash_map(&atoms, filename, line);
+    place_hash_map(atoms.items, atoms.capacity, (struct KeyValuePair){atom, NULL, hash});
+    atoms.count++;
+    return atom;
+}
+
+Atom find_atom(const char* str) {
+    if (atoms.items == NULL)
+        return NULL;
+    const size_t index = find_hash_map(&atoms, str, hash_key(str));
+    return (index < atoms.capacity) ? atoms.items[index].key : NULL;
+}
+
+uint32_t atom_hash(Atom atom) {
+    return ((const struct AtomHeader*)atom - 1)->hash;
 }
 
+void atom_teardown() {
+    if (atoms.items == NULL)
+        return;
+
+    for (size_t i = 0; i < atoms.capacity; i++) {
+        if (atoms.items[i].key == NULL)
+            continue;
+        struct AtomHeader* header = (struct AtomHeader*)atoms.items[i].key - 1;
+        lame_free(&header);
+    }
+    lame_free(&(atoms.items));
+    atoms.count = atoms.capacity = 0;
+}
+
+
 struct HashMap* _create_hash_map(const char* filename, int line) {
     struct HashMap* map = _lame_alloc_clean(sizeof(struct HashMap), filename, line);
     map->capacity = HASH_CAPACITY;
@@ -270,11 +914,9 @@ struct HashMap* _create_hash_map(const char* filename, int line) {
 }
 
 void _destroy_hash_map(struct HashMap* map, bool nuke, const char* filename, int line) {
-    for (size_t i = 0; i < map->capacity; i++) {
+    for (size_t i = 0; nuke && i < map->capacity; i++) {
         struct KeyValuePair* kvp = &map->items[i];
-        if (kvp->key != NULL && kvp->key != HASH_TOMBSTONE)
-            _lame_free((void**)&kvp->key, filename, line);
-        if (nuke && kvp->value != NULL)
+        if (kvp->key != NULL && kvp->value != NULL)
             _lame_free(&kvp->value, filename, line);
     }
 
@@ -282,35 +924,35 @@ void _destroy_hash_map(struct HashMap* map, bool nuke, const char* filename, int
     _lame_free((void**)&map, filename, line);
 }
 
-static bool to_hash_map_direct(
-    struct KeyValuePair* items, size_t* count, size_t* length, size_t capacity, const char* key, void* value, bool nuke,
-    const char* filename, int line
-) {
-    size_t index = (size_t)hash_key(key) % capacity;
-    struct KeyValuePair* kvp = &(items[index]);
-    while (kvp->key != NULL) {
-        if (kvp->key != HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0) {
-            if (kvp->value != NULL) {
-                if (nuke)
-                    _lame_free(&kvp->value, filename, line);
-                else
-                    return false;
-            }
-            kvp->value = value;
-            return true;
-        }
-
-        index = (index + 1) % capacity;
-        kvp = &(items[index]);
+// Returns the map's capacity if the key isn't in there
+static size_t find_hash_map(const struct HashMap* map, const char* key, uint32_t hash) {
+    const size_t mask = map->capacity - 1;
+    size_t index = hash & mask;
+    for (size_t distance = 0;; distance++) {
+        const struct KeyValuePair* kvp = &map->items[index];
+        if (kvp->key == NULL || PROBE_DISTANCE(kvp->hash, index, mask) < distance)
+            return map->capacity;
+        if (kvp->hash == hash && SDL_strcmp(key, kvp->key) == 0)
+            return index;
+        index = (index + 1) & mask;
     }
+}
 
-    items[index].key = count == NULL ? (char*)key : SDL_strdup(key);
-    items[index].value = value;
-    if (count != NULL) {
-        (*count)++;
-        (*length)++;
+static void place_hash_map(struct KeyValuePair* items, size_t capacity, struct KeyValuePair kvp) {
+    const size_t mask = capacity - 1;
+    size_t index = kvp.hash & mask, distance = 0;
+    while (items[index].key != NULL) {
+        const size_t other = PROBE_DISTANCE(items[index].hash, index, mask);
+        if (other < distance) {
+            const struct KeyValuePair swap = items[index];
+            items[index] = kvp;
+            kvp = swap;
+            distance = other;
+        }
+        index = (index + 1) & mask;
+        distance++;
     }
-    return true;
+    items[index] = kvp;
 }
 
 static void expand_hash_map(struct HashMap* map, const char* filename, int line) {
@@ -318,19 +960,10 @@ static void expand_hash_map(struct HashMap* map, const char* filename, int line)
     if (new_capacity < map->capacity)
         log_fatal(src_basename(filename), line, "Capacity overflow in HashMap");
 
-    const size_t old_capacity = map->capacity;
-    const size_t new_size = new_capacity * sizeof(struct KeyValuePair);
-    struct KeyValuePair* items = _lame_alloc_clean(new_size, filename, line);
-
-    for (size_t i = 0; i < map->capacity; i++) {
-        struct KeyValuePair* kvp = &(map->items[i]);
-        if (kvp->key != NULL) {
-            if (kvp->key == HASH_TOMBSTONE)
-                map->length--;
-            else
-                to_hash_map_direct(items, NULL, NULL, new_capacity, kvp->key, kvp->value, false, filename, line);
-        }
-    }
+    struct KeyValuePair* items = _lame_alloc_clean(new_capacity * sizeof(struct KeyValuePair), filename, line);
+    for (size_t i = 0; i < map->capacity; i++)
+        if (map->items[i].key != NULL)
+            place_hash_map(items, new_capacity, map->items[i]);
 
     _lame_free((void**)&(map->items), filename, line);
     map->items = items;
@@ -338,58 +971,70 @@ static void expand_hash_map(struct HashMap* map, const char* filename, int line)
 }
 
 bool _to_hash_map(struct HashMap* map, const char* key, void* value, bool nuke, const char* filename, int line) {
-    if (map->length >= map->capacity / 2)
-        expand_hash_map(map, filename, line);
+    const uint32_t hash = hash_key(key);
+    const size_t index = find_hash_map(map, key, hash);
+    if (index < map->capacity) {
+        struct KeyValuePair* kvp = &map->items[index];
+        if (kvp->value != NULL) {
+            if (nuke)
+                _lame_free(&kvp->value, filename, line);
+            else
+                return false;
+        }
+        kvp->value = value;
+        return true;
+    }
 
-    return to_hash_map_direct(
-        map->items, &(map->count), &(map->length), map->capacity, key, value, nuke, filename, line
-    );
+    if (map->count + 1 > HASH_LOAD(map->capacity))
+        expand_hash_map(map, filename, line);
+    place_hash_map(map->items, map->capacity, (struct KeyValuePair){_intern(key, filename, line), value, hash});
+    map->count++;
+    return true;
 }
 
 void* from_hash_map(struct HashMap* map, const char* key) {
-    size_t index = (size_t)hash_key(key) % map->capacity;
-    const struct KeyValuePair* kvp = &map->items[index];
-    while (kvp->key != NULL) {
-        if (kvp->key != HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0)
-            return kvp->value;
+    const size_t index = find_hash_map(map, key, hash_key(key));
+    return (index < map->capacity) ? map->items[index].value : NULL;
+}
 
-        index = (index + 1) % map->capacity;
-        kvp = &map->items[index];
+void* from_hash_map_atom(struct HashMap* map, Atom atom) {
+    const size_t mask = map->capacity - 1;
+    const uint32_t hash = atom_hash(atom);
+    size_t index = hash & mask;
+    for (size_t distance = 0;; distance++) {
+        const struct KeyValuePair* kvp = &map->items[index];
+        if (kvp->key == NULL || PROBE_DISTANCE(kvp->hash, index, mask) < distance)
+            return NULL;
+        if (kvp->key == atom)
+            return kvp->value;
+        index = (index + 1) & mask;
     }
-
-    return NULL;
 }
 
 void* _pop_hash_map(struct HashMap* map, const char* key, bool nuke, const char* filename, int line) {
-    size_t index = (size_t)hash_key(key) % map->capacity;
-    struct KeyValuePair* kvp = &map->items[index];
-    while (kvp->key != NULL) {
-        if (kvp->key != HASH_TOMBSTONE && SDL_strcmp(key, kvp->key) == 0) {
-            _lame_free((void**)(&(kvp->key)), filename, line);
-            kvp->key = HASH_TOMBSTONE;
-            void* value = kvp->value;
-            kvp->value = NULL;
-            if (nuke && value != NULL)
-                _lame_free(&value, filename, line);
-            map->count--;
-            return value;
-        }
+    size_t index = find_hash_map(map, key, hash_key(key));
+    if (index >= map->capacity)
+        return NULL;
 
-        index = (index + 1) % map->capacity;
-        kvp = &map->items[index];
+    struct KeyValuePair* kvp = &map->items[index];
+    void* value = kvp->value;
+    if (nuke && value != NULL)
+        _lame_free(&value, filename, line);
+
+    // Backward shift: pull the rest of the cluster one slot closer to home
+    const size_t mask = map->capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (map->items[next].key != NULL && PROBE_DISTANCE(map->items[next].hash, next, mask) > 0) {
+        map->items[index] = map->items[next];
+        index = next;
+        next = (next + 1) & mask;
     }
+    map->items[index] = (struct KeyValuePair){NULL, NULL, 0};
 
-    return NULL;
+    map->count--;
+    return value;
 }
 
-static uint32_t int_hash_key(uint32_t key) {
-    uint32_t hash = FNV_OFFSET;
-    for (size_t i = 0; i < sizeof(uint32_t); i++) {
-        hash ^= (uint32_t)(key >> (i << 3)) & 0xFF;
-        hash *= FNV_PRIME;
-    }
-    return hash;
-}
 
 struct IntMap* _create_int_map(const char* filename, int line) {
     struct IntMap* map = _lame_alloc_clean(sizeof(struct IntMap), filename, line);
@@ -401,7 +1046,7 @@ struct IntMap* _create_int_map(const char* filename, int line) {
 void _destroy_int_map(struct IntMap* map, bool nuke, const char* filename, int line) {
     for (size_t i = 0; i < map->capacity; i++) {
         struct IKeyValuePair* kvp = &map->items[i];
-        if (nuke && kvp->value != NULL)
+        if (nuke && kvp->state == IKVP_OCCUPIED && kvp->value != NULL)
             _lame_free(&kvp->value, filename, line);
     }
 
@@ -409,36 +1054,35 @@ void _destroy_int_map(struct IntMap* map, bool nuke, const char* filename, int l
     _lame_free((void**)&map, filename, line);
 }
 
-static bool to_int_map_direct(
-    struct IKeyValuePair* items, size_t* count, size_t* length, size_t capacity, uint32_t key, void* value, bool nuke,
-    const char* filename, int line
-) {
-    size_t index = (size_t)int_hash_key(key) % capacity;
-    struct IKeyValuePair* kvp = &(items[index]);
-    while (kvp->state != IKVP_NONE) {
-        if (kvp->state != IKVP_DELETED && key == kvp->key) {
-            if (kvp->value != NULL) {
-                if (nuke)
-                    _lame_free(&kvp->value, filename, line);
-                else
-                    return false;
-            }
-            kvp->value = value;
-            return true;
-        }
-
-        index = (index + 1) % capacity;
-        kvp = &(items[index]);
+// Returns the map's capacity if the key isn't in there
+static size_t find_int_map(const struct IntMap* map, uint32_t key) {
+    const size_t mask = map->capacity - 1;
+    size_t index = int_hash_key(key) & mask;
+    for (size_t distance = 0;; distance++) {
+        const struct IKeyValuePair* kvp = &map->items[index];
+        if (kvp->state != IKVP_OCCUPIED || PROBE_DISTANCE(int_hash_key(kvp->key), index, mask) < distance)
+            return map->capacity;
+        if (kvp->key == key)
+            return index;
+        index = (index + 1) & mask;
     }
+}
 
-    items[index].state = IKVP_OCCUPIED;
-    items[index].key = key;
-    items[index].value = value;
-    if (count != NULL) {
-        (*count)++;
-        (*length)++;
+static void place_int_map(struct IKeyValuePair* items, size_t capacity, struct IKeyValuePair kvp) {
+    const size_t mask = capacity - 1;
+    size_t index = int_hash_key(kvp.key) & mask, distance = 0;
+    while (items[index].state == IKVP_OCCUPIED) {
+        const size_t other = PROBE_DISTANCE(int_hash_key(items[index].key), index, mask);
+        if (other < distance) {
+            const struct IKeyValuePair swap = items[index];
+            items[index] = kvp;
+            kvp = swap;
+            distance = other;
+        }
+        index = (index + 1) & mask;
+        distance++;
     }
-    return true;
+    items[index] = kvp;
 }
 
 static void expand_int_map(struct IntMap* map, const char* filename, int line) {
@@ -446,19 +1090,10 @@ static void expand_int_map(struct IntMap* map, const char* filename, int line) {
     if (new_capacity < map->capacity)
         log_fatal(src_basename(filename), line, "Capacity overflow in IntMap");
 
-    const size_t old_capacity = map->capacity;
-    const size_t new_size = new_capacity * sizeof(struct IKeyValuePair);
-    struct IKeyValuePair* items = _lame_alloc_clean(new_size, filename, line);
-
-    for (size_t i = 0; i < map->capacity; i++) {
-        struct IKeyValuePair* kvp = &(map->items[i]);
-        if (kvp->state != IKVP_NONE) {
-            if (kvp->state == IKVP_DELETED)
-                map->length--;
-            else
-                to_int_map_direct(items, NULL, NULL, new_capacity, kvp->key, kvp->value, false, filename, line);
-        }
-    }
+    struct IKeyValuePair* items = _lame_alloc_clean(new_capacity * sizeof(struct IKeyValuePair), filename, line);
+    for (size_t i = 0; i < map->capacity; i++)
+        if (map->items[i].state == IKVP_OCCUPIED)
+            place_int_map(items, new_capacity, map->items[i]);
 
     _lame_free((void**)&(map->items), filename, line);
     map->items = items;
@@ -466,45 +1101,51 @@ static void expand_int_map(struct IntMap* map, const char* filename, int line) {
 }
 
 bool _to_int_map(struct IntMap* map, uint32_t key, void* value, bool nuke, const char* filename, int line) {
-    if (map->length >= map->capacity / 2)
-        expand_int_map(map, filename, line);
+    const size_t index = find_int_map(map, key);
+    if (index < map->capacity) {
+        struct IKeyValuePair* kvp = &map->items[index];
+        if (kvp->value != NULL) {
+            if (nuke)
+                _lame_free(&kvp->value, filename, line);
+            else
+                return false;
+        }
+        kvp->value = value;
+        return true;
+    }
 
-    return to_int_map_direct(
-        map->items, &(map->count), &(map->length), map->capacity, key, value, nuke, filename, line
-    );
+    if (map->count + 1 > HASH_LOAD(map->capacity))
+        expand_int_map(map, filename, line);
+    place_int_map(map->items, map->capacity, (struct IKeyValuePair){IKVP_OCCUPIED, key, value});
+    map->count++;
+    return true;
 }
 
 void* from_int_map(struct IntMap* map, uint32_t key) {
-    size_t index = (size_t)int_hash_key(key) % map->capacity;
-    const struct IKeyValuePair* kvp = &map->items[index];
-    while (kvp->state != IKVP_NONE) {
-        if (kvp->state != IKVP_DELETED && key == kvp->key)
-            return kvp->value;
-
-        index = (index + 1) % map->capacity;
-        kvp = &map->items[index];
-    }
-
-    return NULL;
+    const size_t index = find_int_map(map, key);
+    return (index < map->capacity) ? map->items[index].value : NULL;
 }
 
 void* _pop_int_map(struct IntMap* map, uint32_t key, bool nuke, const char* filename, int line) {
-    size_t index = (size_t)int_hash_key(key) % map->capacity;
-    struct IKeyValuePair* kvp = &map->items[index];
-    while (kvp->state != IKVP_NONE) {
-        if (kvp->state != IKVP_DELETED && key == kvp->key) {
-            kvp->state = IKVP_DELETED;
-            void* value = kvp->value;
-            kvp->value = NULL;
-            if (nuke && value != NULL)
-                _lame_free(&value, filename, line);
-            map->count--;
-            return value;
-        }
+    size_t index = find_int_map(map, key);
+    if (index >= map->capacity)
+        return NULL;
 
-        index = (index + 1) % map->capacity;
-        kvp = &map->items[index];
+    void* value = map->items[index].value;
+    if (nuke && value != NULL)
+        _lame_free(&value, filename, line);
+
+    // Backward shift: pull the rest of the cluster one slot closer to home
+    const size_t mask = map->capacity - 1;
+    size_t next = (index + 1) & mask;
+    while (map->items[next].state == IKVP_OCCUPIED &&
+           PROBE_DISTANCE(int_hash_key(map->items[next].key), next, mask) > 0) {
+        map->items[index] = map->items[next];
+        index = next;
+        next = (next + 1) & mask;
     }
+    map->items[index] = (struct IKeyValuePair){IKVP_NONE, 0, NULL};
 
-    return NULL;
+    map->count--;
+    return value;
 }
@@ -35,27 +35,165 @@ void _lame_set(void*, char, size_t, const char*, int);
         (varname) = 0;                                                                                                 \
     }
 
-uint8_t read_u8(uint8_t**);
-uint16_t _read_u16(uint8_t**, const char*, int);
-uint32_t _read_u32(uint8_t**, const char*, int);
-uint64_t _read_u64(uint8_t**, const char*, int);
-int8_t read_s8(uint8_t**);
-int16_t _read_s16(uint8_t**, const char*, int);
-int32_t _read_s32(uint8_t**, const char*, int);
-int64_t _read_s64(uint8_t**, const char*, int);
-float _read_f32(uint8_t**, const char*, int);
-double _read_f64(uint8_t**, const char*, int);
-char* read_string(uint8_t**);
-
-#define read_bool(buf) (bool)read_u8(buf)
-#define read_u16(buf) _read_u16(buf, __FILE__, __LINE__)
-#define read_u32(buf) _read_u32(buf, __FILE__, __LINE__)
-#define read_u64(buf) _read_u64(buf, __FILE__, __LINE__)
-#define read_s16(buf) _read_s16(buf, __FILE__, __LINE__)
-#define read_s32(buf) _read_s32(buf, __FILE__, __LINE__)
-#define read_s64(buf) _read_s64(buf, __FILE__, __LINE__)
-#define read_f32(buf) _read_f32(buf, __FILE__, __LINE__)
-#define read_f64(buf) _read_f64(buf, __FILE__, __LINE__)
+/*
+   Allocation tracking, enabled with -DLAME_TRACK_ALLOCATIONS in debug builds.
+
+   Every allocation that goes through lame_alloc() and friends is recorded
+   under the __FILE__ and __LINE__ it came from, along with live bytes, peak
+   usage and the allocation rate per tick. dump_allocations() prints a report
+   (also done on exit, where anything still live is a leak). Release builds
+   compile all of it out.
+
+   Once a level is running, the main loop marks its tick, render and audio
+   phases. Those shouldn't allocate at all, so the first allocation from each
+   call site (or Lua line) inside a phase gets logged. Frames spent loading are
+   marked too, but allocating there is expected. Phases are kept in release
+   builds so other accounting (like Lua memory) can use them.
+*/
+#ifdef NDEBUG
+#undef LAME_TRACK_ALLOCATIONS
+#endif
+
+enum AllocPhases {
+    AP_NONE,
+    AP_TICK,
+    AP_RENDER,
+    AP_AUDIO,
+    AP_LOAD,
+    AP_SIZE,
+};
+
+void set_alloc_phase(enum AllocPhases);
+enum AllocPhases get_alloc_phase();
+const char* get_alloc_phase_name(enum AllocPhases);
+
+#ifdef LAME_TRACK_ALLOCATIONS
+#define ALLOC_SITES_MAX 4096
+#define ALLOC_REPORT_SITES 64 // Call sites listed in reports
+#define ALLOC_LABEL_MAX 64
+
+void tick_allocations();
+void dump_allocations();
+void track_script_alloc(const void*, const char*, int, size_t);
+#else
+#define tick_allocations()
+#define dump_allocations()
+#endif
+
+/*
+   Frame arena for transient work on the main thread.
+
+   Allocations are bumped off a linear block and never freed individually;
+   everything is released at once by lame_frame_reset(), which happens at the
+   start of every tick_update() and video_update(). Don't keep frame pointers
+   across either of those.
+
+   When a block runs out, another one is chained after it. On the next reset
+   the chain is merged into a single block big enough for the high-water mark.
+
+   Scratch that's dead once a function returns should be given back with
+   lame_frame_mark()/lame_frame_release(), otherwise loops that call it
+   between resets (crowd baking, spawning a level's actors) pile up.
+*/
+#define FRAME_ARENA_SIZE 1048576 // Initial block size in bytes
+#define FRAME_ARENA_ALIGN 16
+
+struct FrameMark {
+    struct FrameBlock* block;
+    size_t block_used, used;
+};
+
+void* _lame_frame_alloc(size_t, const char*, int);
+void lame_frame_reset();
+struct FrameMark lame_frame_mark();
+void lame_frame_release(struct FrameMark);
+void lame_frame_teardown();
+size_t lame_frame_used();
+size_t lame_frame_peak();
+
+#define lame_frame_alloc(size) _lame_frame_alloc(size, __FILE__, __LINE__)
+
+// Arenas hand out zeroed memory from chained blocks that are all freed together.
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size, used;
+    uint8_t* data;
+};
+
+struct Arena {
+    struct ArenaBlock* blocks; // Newest first
+    size_t block_size, used;
+};
+
+struct Arena* _create_arena(size_t, const char*, int);
+void _destroy_arena(struct Arena*, const char*, int);
+void* _arena_alloc(struct Arena*, size_t, const char*, int);
+char* _arena_strdup(struct Arena*, const char*, const char*, int);
+
+#define create_arena(block_size) _create_arena(block_size, __FILE__, __LINE__)
+#define destroy_arena(arena) _destroy_arena(arena, __FILE__, __LINE__)
+#define arena_alloc(arena, size) _arena_alloc(arena, size, __FILE__, __LINE__)
+#define arena_strdup(arena, str) _arena_strdup(arena, str, __FILE__, __LINE__)
+
+// Pools hand out fixed-size zeroed items from slabs, recycled through a free list.
+#define POOL_ALIGN 16
+
+struct PoolSlab {
+    struct PoolSlab* next;
+    uint8_t* items;
+};
+
+struct Pool {
+    const char* name;
+    size_t item_size, slab_size;
+    struct PoolSlab* slabs;
+    void* free_list;
+    size_t count, capacity; // Count = live items, capacity = items across slabs.
+};
+
+struct Pool* _create_pool(const char*, size_t, size_t, const char*, int);
+void _destroy_pool(struct Pool*, const char*, int);
+void* _pool_alloc(struct Pool*, const char*, int);
+void _pool_free(struct Pool*, void**, const char*, int);
+
+#define create_pool(name, size, slab_size) _create_pool(name, size, slab_size, __FILE__, __LINE__)
+#define destroy_pool(pool) _destroy_pool(pool, __FILE__, __LINE__)
+#define pool_alloc(pool) _pool_alloc(pool, __FILE__, __LINE__)
+#define pool_free(pool, ptr) _pool_free(pool, (void**)(ptr), __FILE__, __LINE__)
+
+// Binary readers
+// Little-endian cursor over a loaded buffer. Reads never go past the end:
+// instead they return zeroes and set the overflow flag, so check it once after
+// parsing rather than after every read.
+struct BinaryReader {
+    uint8_t *ptr, *end;
+    bool overflow;
+};
+
+#define binary_reader(buf, size) ((struct BinaryReader){(uint8_t*)(buf), (uint8_t*)(buf) + (size), false})
+
+size_t reader_remaining(const struct BinaryReader*);
+bool read_magic(struct BinaryReader*, const char*);
+void skip_bytes(struct BinaryReader*, size_t);
+
+uint8_t read_u8(struct BinaryReader*);
+uint16_t read_u16(struct BinaryReader*);
+uint32_t read_u32(struct BinaryReader*);
+uint64_t read_u64(struct BinaryReader*);
+int8_t read_s8(struct BinaryReader*);
+int16_t read_s16(struct BinaryReader*);
+int32_t read_s32(struct BinaryReader*);
+int64_t read_s64(struct BinaryReader*);
+float read_f32(struct BinaryReader*);
+double read_f64(struct BinaryReader*);
+char* read_string(struct BinaryReader*);
+
+void read_u8_array(struct BinaryReader*, uint8_t*, size_t);
+void read_f32_array(struct BinaryReader*, float*, size_t);
+
+#define read_bool(reader) (bool)read_u8(reader)
 
 /*
    This is a handle system I made on a whim. It's called "bumbling smartass".
@@ -66,33 +204,44 @@ char* read_string(uint8_t**);
 
    By default, HandleIDs are 32-bit integers; first 16 bits is index, the rest
    is generation. So even though Fixture capacity grows dynamically, the hard
-   limit to Handle amount per fixture is ~65535.
+   limit to Handle amount per fixture is ~65535. Build with LAME_WIDE_HANDLES
+   for 64-bit HandleIDs split into 32-bit index and generation.
 
-   The smallest invalid Handle index always gets recycled. That's why Handles
-   have incrementing generations on create; that way you still get NULL on
-   stale HandleIDs. Generations always start at 1, then wrap after 65535.
-   So unless you create and destroy a godless amount of Handles (around 65k to
-   4.2b), there's no chance of a stale HandleID working again.
+   Invalid Handles form a free list, oldest first, so creating and destroying
+   are O(1). That's why Handles have incrementing generations on create; that
+   way you still get NULL on stale HandleIDs. Generations always start at 1,
+   then wrap after 65535 (or ~4.2b when wide). Recycling the oldest index
+   spreads churn across the whole array, so unless you create and destroy a
+   godless amount of Handles, there's no chance of a stale HandleID working
+   again.
 
    If a generation wraparound does happen though, you'll at least get a warning
    in the log.
 */
+#ifdef LAME_WIDE_HANDLES
+#define HID_TYPE uint64_t
+#define HID_HALF uint32_t
+#define HID_BITS 32
+#define HID_LIMIT 0xFFFFFFFF
+#else
+#define HID_TYPE uint32_t
+#define HID_HALF uint16_t
+#define HID_BITS 16
+#define HID_LIMIT 0xFFFF
+#endif
+
 struct Fixture {
     struct Handle* handles;
-    size_t size, capacity; // Size = live handles, capacity = array size.
-    size_t next;           // Next invalid handle in the array.
+    size_t size, capacity;          // Size = live handles, capacity = array size.
+    HID_HALF first_free, last_free; // Free list ends, HID_LIMIT if empty.
 };
 
 struct Handle {
     void* ptr;
-    uint16_t generation;
+    HID_HALF generation;
+    HID_HALF next_free; // Next invalid handle, only meaningful while invalid.
 };
 
-#define HID_TYPE uint32_t
-#define HID_HALF uint16_t
-#define HID_BITS 16
-#define HID_LIMIT 0xFFFF
-
 typedef HID_TYPE HandleID;
 
 struct Fixture* _create_fixture(const char*, int);
@@ -107,24 +256,41 @@ void _destroy_handle(struct Fixture*, HandleID, const char*, int);
 
 struct Handle* hid_to_handle(struct Fixture*, HandleID);
 void* hid_to_pointer(struct Fixture*, HandleID);
+size_t hids_to_pointers(struct Fixture*, const HandleID*, void**, size_t);
 
-// Hash maps
-#define HASH_TOMBSTONE ((char*)(-1))
+// Atoms
+// Interned strings: each distinct string gets one pointer that lives until
+// shutdown, so atoms compare with == and carry their own hash. Main thread only.
+typedef const char* Atom;
 
+Atom _intern(const char*, const char*, int);
+Atom find_atom(const char*);
+uint32_t atom_hash(Atom);
+void atom_teardown();
+
+#define intern(str) _intern(str, __FILE__, __LINE__)
+
+// Hash maps
+// Items are a power-of-two table where empty slots have NULL keys (IntMaps use
+// IKVP_NONE). Popping pulls later items back into the freed slot, so look at
+// the same slot again when popping while walking the table.
+// Keys are atoms, so lookups by atom skip hashing and strcmp entirely.
 struct KeyValuePair {
-    char* key;
+    Atom key;
     void* value;
+    uint32_t hash;
 };
 
 struct HashMap {
     struct KeyValuePair* items;
-    size_t count, length, capacity;
+    size_t count, capacity;
 };
 
 struct HashMap* _create_hash_map(const char*, int);
 void _destroy_hash_map(struct HashMap*, bool, const char*, int);
 bool _to_hash_map(struct HashMap*, const char*, void*, bool, const char*, int);
 void* from_hash_map(struct HashMap*, const char*);
+void* from_hash_map_atom(struct HashMap*, Atom);
 void* _pop_hash_map(struct HashMap*, const char*, bool, const char*, int);
 
 #define create_hash_map() _create_hash_map(__FILE__, __LINE__)
@@ -136,7 +302,6 @@ void* _pop_hash_map(struct HashMap*, const char*, bool, const char*, int);
 enum IKVPState {
     IKVP_NONE,
     IKVP_OCCUPIED,
-    IKVP_DELETED,
 };
 
 struct IKeyValuePair {
@@ -147,7 +312,7 @@ struct IKeyValuePair {
 
 struct IntMap {
     struct IKeyValuePair* items;
-    size_t count, length, capacity;
+    size_t count, capacity;
 };
 
 struct IntMap* _create_int_map(const char*, int);
@@ -94,7 +94,10 @@ static SDL_EnumerationResult iterate_mods(void* userdata, const char* dirname, c
     mod->previous = mods;
     mods = mod;
 
-    DEBUG("Added mod \"%s\" v%u (%u, %s -> %u)", mod->title, mod->version, mod->hid, mod->name, mod->crc32);
+    DEBUG(
+        "Added mod \"%s\" v%u (%" SDL_PRIu64 ", %s -> %u)", mod->title, mod->version, (uint64_t)mod->hid, mod->name,
+        mod->crc32
+    );
     return SDL_ENUM_CONTINUE;
 }
 
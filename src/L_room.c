@@ -1,14 +1,13 @@
 #include "L_room.h"
 
+// Grow the bump map's bounds to cover a position. Chunks get allocated once the bounds are final.
 void update_bump_map(struct BumpMap* bump, vec2 pos) {
-    if (bump->chunks == NULL) {
-        bump->chunks = (struct Actor**)lame_alloc_clean(sizeof(struct Actor*));
+    if (bump->size[0] <= 0 || bump->size[1] <= 0) {
         glm_vec2_copy(pos, bump->pos);
         bump->size[0] = bump->size[1] = 1;
         return;
     }
 
-    bool update = false;
     float old_x1 = bump->pos[0];
     float old_y1 = bump->pos[1];
     float old_x2 = bump->pos[0] + (float)(bump->size[0] * BUMP_CHUNK_SIZE);
@@ -17,25 +16,15 @@ void update_bump_map(struct BumpMap* bump, vec2 pos) {
     if (pos[0] < old_x1) {
         bump->pos[0] = pos[0];
         bump->size[0] = (size_t)SDL_ceil((old_x2 - pos[0]) / (float)BUMP_CHUNK_SIZE);
-        update = true;
     } else if (pos[0] > old_x2) {
         bump->size[0] += (size_t)SDL_ceil((pos[0] - old_x2) / (float)BUMP_CHUNK_SIZE);
-        update = true;
     }
 
     if (pos[1] < old_y1) {
         bump->pos[1] = pos[1];
         bump->size[1] = (size_t)SDL_ceil((old_y2 - pos[1]) / (float)BUMP_CHUNK_SIZE);
-        update = true;
     } else if (pos[1] > old_y2) {
         bump->size[1] += (size_t)SDL_ceil((pos[1] - old_y2) / (float)BUMP_CHUNK_SIZE);
-        update = true;
-    }
-
-    if (update) {
-        const size_t size = bump->size[0] * bump->size[1] * sizeof(struct Actor*);
-        lame_realloc(&bump->chunks, size);
-        lame_set(bump->chunks, 0, size);
     }
 }
 
@@ -49,22 +38,17 @@ void destroy_room(struct Room* room) {
     while (room->actors != NULL)
         destroy_actor(room->actors, false, false);
 
+    // The room and its room actors belong to the level arena, so only release what they hold
     struct RoomActor* it = room->room_actors;
     while (it != NULL) {
-        struct RoomActor* next = it->previous;
         unreference(&(it->special));
-        lame_free(&it);
-        it = next;
+        it = it->previous;
     }
 
-    if (room->bump.chunks != NULL)
-        lame_free(&(room->bump.chunks));
-
     CLOSE_POINTER(room->model, destroy_model_instance);
     CLOSE_POINTER(room->sounds, destroy_world_sound_pool);
 
     unreference_pointer(&(room->userdata));
-    lame_free(&room);
 }
 
 void activate_room(struct Room* room) {
@@ -39,6 +39,7 @@ enum RoomActorFlags {
     RAF_PERSISTENT = 1 << 0, // Enables AF_PERSISTENT.
     RAF_DISPOSABLE = 1 << 1, // Enables AF_DISPOSABLE.
     RAF_DISPOSED = 1 << 2,   // Won't be spawned upon activating the room.
+    RAF_STATIC = 1 << 3,     // Enables AF_STATIC.
 
     RAF_DEFAULT = RAF_NONE,
 };
@@ -79,6 +80,8 @@ struct Room {
     vec2 fog_distance;
     vec4 fog_color;
     vec4 wind; // (0-2) Wind direction and (3) factor
+
+    bool depth_prepass; // Lay down depth for models before shading them
 };
 
 struct RoomActor {
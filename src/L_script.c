@@ -14,6 +14,32 @@
 
 static lua_State* context = NULL;
 static lua_Debug debug = {0};
+static int atom_cache = LUA_NOREF;
+
+// Lua only ever runs on the main thread, so none of this needs a lock
+static struct Pool* script_pools[SCRIPT_SIZE_CLASSES] = {NULL};
+static size_t script_live_bytes = 0, script_peak_bytes = 0;
+static size_t script_phase_allocated[AP_SIZE] = {0}, script_phase_freed[AP_SIZE] = {0};
+static const char* script_callback = NULL; // Name of the callback being run, allocations are blamed on it
+
+// Lua strings are already interned, so this saves rehashing names that scripts pass every tick
+static Atom s_check_atom(lua_State* L, int arg) {
+    luaL_checkstring(L, arg);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, atom_cache);
+    lua_pushvalue(L, arg);
+    lua_rawget(L, -2);
+
+    Atom atom = (Atom)lua_touserdata(L, -1);
+    if (atom == NULL) {
+        atom = intern(lua_tostring(L, arg));
+        lua_pushvalue(L, arg);
+        lua_pushlightuserdata(L, (void*)atom);
+        lua_rawset(L, -4);
+    }
+    lua_pop(L, 2);
+
+    return atom;
+}
 
 // Script functions
 // Types
@@ -51,6 +77,23 @@ SCRIPT_FUNCTION(error) {
     return luaL_error(L, msg);
 }
 
+SCRIPT_FUNCTION_DIRECT(dump_allocations);
+SCRIPT_FUNCTION_DIRECT(log_script_memory);
+
+SCRIPT_FUNCTION(get_script_memory) {
+    lua_createtable(L, 0, AP_SIZE + 2);
+    lua_pushinteger(L, (lua_Integer)script_live_bytes);
+    lua_setfield(L, -2, "live");
+    lua_pushinteger(L, (lua_Integer)script_peak_bytes);
+    lua_setfield(L, -2, "peak");
+    // Net bytes per phase, negative if the phase freed more than it allocated
+    for (enum AllocPhases i = AP_NONE; i < AP_SIZE; i++) {
+        lua_pushinteger(L, (lua_Integer)script_phase_allocated[i] - (lua_Integer)script_phase_freed[i]);
+        lua_setfield(L, -2, get_alloc_phase_name(i));
+    }
+    return 1;
+}
+
 // Localization
 SCRIPT_FUNCTION(localized) {
     const char* key = luaL_checkstring(L, 1);
@@ -71,6 +114,35 @@ SCRIPT_ASSET(music, track, struct Track*, TrackID);
 // Video
 SCRIPT_GETTER(get_draw_time, integer);
 
+SCRIPT_FUNCTION(get_gpu_memory) {
+    if (lua_isnoneornil(L, 1)) {
+        lua_pushinteger(L, (lua_Integer)get_gpu_memory_total());
+        return 1;
+    }
+
+    const lua_Integer type = luaL_checkinteger(L, 1);
+    if (type < 0 || type >= GMT_SIZE)
+        luaL_argerror(L, 1, "invalid GPU memory type");
+    lua_pushinteger(L, (lua_Integer)get_gpu_memory((enum GPUMemoryTypes)type));
+    return 1;
+}
+
+SCRIPT_FUNCTION_DIRECT(dump_gpu_memory);
+
+SCRIPT_FUNCTION(get_render_stats) {
+    const bool average = lua_toboolean(L, 1);
+
+    lua_createtable(L, 0, RS_SIZE);
+    for (enum RenderStats i = 0; i < RS_SIZE; i++) {
+        if (average)
+            lua_pushnumber(L, get_render_stat_average(i));
+        else
+            lua_pushinteger(L, (lua_Integer)get_render_stat(i));
+        lua_setfield(L, -2, get_render_stat_name(i));
+    }
+    return 1;
+}
+
 SCRIPT_FUNCTION(set_main_color) {
     const GLfloat r = (GLfloat)luaL_checknumber(L, 1);
     const GLfloat g = (GLfloat)luaL_checknumber(L, 2);
@@ -225,7 +297,13 @@ SCRIPT_FUNCTION(model_instance_set_hidden) {
 
     if (index < 0 || index >= inst->model->num_submodels)
         luaL_argerror(L, 2, "invalid submodel index");
-    inst->hidden[index] = hidden;
+    if (inst->hidden[index] != hidden) {
+        inst->hidden[index] = hidden;
+        if (hidden)
+            inst->num_hidden++;
+        else
+            inst->num_hidden--;
+    }
 
     return 0;
 }
@@ -240,6 +318,24 @@ SCRIPT_FUNCTION(model_instance_set_animation) {
     return 0;
 }
 
+SCRIPT_FUNCTION(model_instance_attach) {
+    struct ModelInstance* inst = s_check_model_instance(L, 1);
+    struct ModelInstance* parent = s_check_model_instance(L, 2);
+    const lua_Integer node = luaL_optinteger(L, 3, 0);
+    if (node < 0 || node >= parent->model->num_nodes)
+        luaL_argerror(L, 3, "invalid node index");
+
+    if (!attach_model_instance(inst, parent, (size_t)node))
+        luaL_argerror(L, 2, "cyclic attachment");
+    return 0;
+}
+
+SCRIPT_FUNCTION(model_instance_detach) {
+    struct ModelInstance* inst = s_check_model_instance(L, 1);
+    detach_model_instance(inst);
+    return 0;
+}
+
 SCRIPT_FUNCTION(model_instance_override_texture) {
     struct ModelInstance* inst = s_check_model_instance(L, 1);
     const lua_Integer material_index = luaL_checkinteger(L, 2);
@@ -247,7 +343,7 @@ SCRIPT_FUNCTION(model_instance_override_texture) {
         luaL_argerror(L, 2, "invalid material index");
     struct Texture* texture = s_test_texture(L, 3);
 
-    inst->override_textures[material_index] = (texture == NULL) ? 0 : texture->texture;
+    override_model_instance_texture(inst, (size_t)material_index, texture);
     return 0;
 }
 
@@ -258,12 +354,52 @@ SCRIPT_FUNCTION(model_instance_override_texture_surface) {
         luaL_argerror(L, 2, "invalid material index");
     struct Surface* surface = s_test_surface(L, 3);
 
-    if (surface != NULL) {
-        validate_surface(surface);
-        inst->override_textures[material_index] = surface->texture[SURFACE_COLOR_TEXTURE];
-    } else {
-        inst->override_textures[material_index] = 0;
-    }
+    override_model_instance_surface(inst, (size_t)material_index, surface);
+    return 0;
+}
+
+// Crowd
+SCRIPT_CHECKER_DIRECT(crowd, struct Crowd*);
+
+SCRIPT_FUNCTION(create_crowd) {
+    struct Model* model = s_check_model(L, 1);
+    if (model->num_bones <= 0)
+        luaL_argerror(L, 1, "model has no bones");
+    struct Animation* animation = s_check_animation(L, 2);
+    if (animation->num_frames <= 0)
+        luaL_argerror(L, 2, "animation has no frames");
+
+    create_crowd(true, model, animation);
+    return 1;
+}
+
+SCRIPT_FUNCTION(dispose_crowd) {
+    struct Crowd* crowd = s_check_crowd(L, 1);
+    dispose_crowd(crowd);
+    return 0;
+}
+
+SCRIPT_FUNCTION(crowd_add) {
+    struct Crowd* crowd = s_check_crowd(L, 1);
+    vec3 pos = {(float)luaL_checknumber(L, 2), (float)luaL_checknumber(L, 3), (float)luaL_checknumber(L, 4)};
+    vec3 angle = {(float)luaL_optnumber(L, 5, 0), (float)luaL_optnumber(L, 6, 0), (float)luaL_optnumber(L, 7, 0)};
+    const float frame = (float)luaL_optnumber(L, 8, 0);
+    const float speed = (float)luaL_optnumber(L, 9, 1);
+    const float scale = (float)luaL_optnumber(L, 10, 1);
+
+    add_crowd_instance(crowd, pos, angle, (vec3){scale, scale, scale}, frame, speed);
+    return 0;
+}
+
+SCRIPT_FUNCTION(crowd_clear) {
+    struct Crowd* crowd = s_check_crowd(L, 1);
+    clear_crowd(crowd);
+    return 0;
+}
+
+SCRIPT_FUNCTION(crowd_draw) {
+    struct Crowd* crowd = s_check_crowd(L, 1);
+    draw_crowd(crowd);
     return 0;
 }
 
@@ -327,8 +463,7 @@ SCRIPT_FUNCTION(actor_exists) {
 
 SCRIPT_FUNCTION(actor_is_ancestor) {
     struct Actor* actor = s_check_actor(L, 1);
-    const char* type = luaL_checkstring(L, 2);
-    lua_pushboolean(L, actor_is_ancestor(actor, type));
+    lua_pushboolean(L, actor_is_ancestor_atom(actor, s_check_atom(L, 2)));
     return 1;
 }
 
@@ -961,14 +1096,73 @@ SCRIPT_FUNCTION(lengthdir_3d) {
 }
 
 // Meat and bones
+// Lua passes the old size back on every call, so blocks don't need headers to know their size class
+static void* script_block_alloc(size_t size) {
+    if (size > SCRIPT_SMALL_SIZE)
+        return SDL_malloc(size);
+
+    const size_t class = (size - 1) / SCRIPT_SIZE_CLASS;
+    if (script_pools[class] == NULL) {
+        const size_t item_size = (class + 1) * SCRIPT_SIZE_CLASS;
+        script_pools[class] = create_pool("Lua", item_size, SCRIPT_SLAB_SIZE / item_size);
+    }
+    return pool_alloc(script_pools[class]);
+}
+
+static void script_block_free(void* ptr, size_t size) {
+    if (size > SCRIPT_SMALL_SIZE)
+        SDL_free(ptr);
+    else
+        pool_free(script_pools[(size - 1) / SCRIPT_SIZE_CLASS], &ptr);
+}
+
 static void* script_alloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+    // osize is the object type for new blocks
+    const size_t old_size = (ptr != NULL) ? osize : 0;
+    const enum AllocPhases phase = get_alloc_phase();
+    script_phase_allocated[phase] += nsize;
+    script_phase_freed[phase] += old_size;
+    script_live_bytes = script_live_bytes + nsize - old_size;
+    script_peak_bytes = SDL_max(script_peak_bytes, script_live_bytes);
+
     if (nsize == 0) {
-        SDL_free(ptr);
+        if (ptr != NULL)
+            script_block_free(ptr, old_size);
         return NULL;
     }
-    void* nptr = SDL_realloc(ptr, nsize);
+
+#ifdef LAME_TRACK_ALLOCATIONS
+    // Never look at the Lua stack from here, Lua calls this halfway through
+    // reallocating it
+    if (phase != AP_NONE && phase != AP_LOAD && nsize > old_size) {
+        if (script_callback != NULL)
+            track_script_alloc(script_callback, script_callback, 0, nsize);
+        else
+            track_script_alloc("(Lua)", "(Lua)", 0, nsize);
+    }
+#endif
+    if (ptr != NULL) {
+        // Big blocks that stay big can grow in place
+        if (old_size > SCRIPT_SMALL_SIZE && nsize > SCRIPT_SMALL_SIZE) {
+            void* nptr = SDL_realloc(ptr, nsize);
+            if (nptr == NULL)
+                FATAL("script_alloc fail");
+            return nptr;
+        }
+
+        // Already in the right size class
+        if (old_size <= SCRIPT_SMALL_SIZE && nsize <= SCRIPT_SMALL_SIZE &&
+            (old_size - 1) / SCRIPT_SIZE_CLASS == (nsize - 1) / SCRIPT_SIZE_CLASS)
+            return ptr;
+    }
+
+    void* nptr = script_block_alloc(nsize);
     if (nptr == NULL)
         FATAL("script_alloc fail");
+    if (ptr != NULL) {
+        SDL_memcpy(nptr, ptr, SDL_min(old_size, nsize));
+        script_block_free(ptr, old_size);
+    }
     return nptr;
 }
 
@@ -977,6 +1171,9 @@ void script_init() {
     if (context == NULL)
         FATAL("lua_newstate fail");
 
+    lua_newtable(context);
+    atom_cache = luaL_ref(context, LUA_REGISTRYINDEX);
+
     // Expose a lot of things
     EXPOSE_PACKAGE(LUA_LOADLIBNAME, luaopen_package);
     EXPOSE_PACKAGE(LUA_MATHLIBNAME, luaopen_math);
@@ -993,6 +1190,9 @@ void script_init() {
     // Debug
     EXPOSE_FUNCTION(print);
     EXPOSE_FUNCTION(error);
+    EXPOSE_FUNCTION(dump_allocations);
+    EXPOSE_FUNCTION(log_script_memory);
+    EXPOSE_FUNCTION(get_script_memory);
 
     // Players
     luaL_newmetatable(context, "player");
@@ -1055,6 +1255,17 @@ void script_init() {
 
     EXPOSE_FUNCTION(get_draw_time);
 
+    EXPOSE_INTEGER(GMT_TEXTURE);
+    EXPOSE_INTEGER(GMT_MODEL);
+    EXPOSE_INTEGER(GMT_SURFACE);
+    EXPOSE_INTEGER(GMT_BATCH);
+    EXPOSE_INTEGER(GMT_PALETTE);
+    EXPOSE_INTEGER(GMT_CROWD);
+    EXPOSE_INTEGER(GMT_STAGING);
+    EXPOSE_FUNCTION(get_gpu_memory);
+    EXPOSE_FUNCTION(dump_gpu_memory);
+    EXPOSE_FUNCTION(get_render_stats);
+
     EXPOSE_FUNCTION(set_main_color);
     EXPOSE_FUNCTION(set_main_alpha);
 
@@ -1094,6 +1305,9 @@ void script_init() {
         {"set_hidden", s_model_instance_set_hidden},
         {"set_animation", s_model_instance_set_animation},
 
+        {"attach", s_model_instance_attach},
+        {"detach", s_model_instance_detach},
+
         {"override_texture", s_model_instance_override_texture},
         {"override_texture_surface", s_model_instance_override_texture_surface},
 
@@ -1104,6 +1318,23 @@ void script_init() {
     lua_setfield(context, -2, "__index");
     lua_pop(context, 1);
 
+    luaL_newmetatable(context, "crowd");
+    static const luaL_Reg crowd_methods[] = {
+        {"add", s_crowd_add},
+        {"clear", s_crowd_clear},
+        {"draw", s_crowd_draw},
+        {"dispose", s_dispose_crowd},
+        {"__gc", s_dispose_crowd},
+
+        {NULL, NULL},
+    };
+    luaL_setfuncs(context, crowd_methods, 0);
+    lua_pushvalue(context, -1);
+    lua_setfield(context, -2, "__index");
+    lua_pop(context, 1);
+
+    EXPOSE_FUNCTION(create_crowd);
+
     // Audio
     EXPOSE_FUNCTION(play_ui_sound);
 
@@ -1287,6 +1518,9 @@ void script_teardown() {
 
     lua_settop(context, 0);
     lua_close(context);
+    log_script_memory();
+    for (size_t i = 0; i < SCRIPT_SIZE_CLASSES; i++)
+        CLOSE_POINTER(script_pools[i], destroy_pool);
 
     INFO("Closed");
 }
@@ -1311,6 +1545,24 @@ void collect_garbage() {
     lua_gc(context, LUA_GCCOLLECT);
 }
 
+void log_script_memory() {
+    size_t pooled = 0;
+    for (size_t i = 0; i < SCRIPT_SIZE_CLASSES; i++)
+        if (script_pools[i] != NULL)
+            pooled += script_pools[i]->count * script_pools[i]->item_size;
+
+    INFO(
+        "Lua memory: %zu bytes live (%zu in size class pools), peaked at %zu bytes", script_live_bytes, pooled,
+        script_peak_bytes
+    );
+    INFO(
+        "Lua memory by phase: %+" SDL_PRIs64 " tick, %+" SDL_PRIs64 " render, %+" SDL_PRIs64 " load",
+        (Sint64)script_phase_allocated[AP_TICK] - (Sint64)script_phase_freed[AP_TICK],
+        (Sint64)script_phase_allocated[AP_RENDER] - (Sint64)script_phase_freed[AP_RENDER],
+        (Sint64)script_phase_allocated[AP_LOAD] - (Sint64)script_phase_freed[AP_LOAD]
+    );
+}
+
 void* userdata_alloc(const char* type, size_t size) {
     void* userdata = lua_newuserdata(context, size);
     luaL_setmetatable(context, type);
@@ -1454,23 +1706,32 @@ void unreference_pointer(int* ref) {
 
 void _execute_ref(int ref, const char* name, const char* filename, int line) {
     lua_rawgeti(context, LUA_REGISTRYINDEX, ref);
+    const char* outer = script_callback;
+    script_callback = name;
     if (lua_pcall(context, 0, 0, 0) != LUA_OK)
         log_fatal(src_basename(filename), line, "Error from \"%s\": %s", name, lua_tostring(context, -1));
+    script_callback = outer;
 }
 
 void _execute_ref_in(int ref, int userdata, const char* name, const char* filename, int line) {
     lua_rawgeti(context, LUA_REGISTRYINDEX, ref);
     lua_rawgeti(context, LUA_REGISTRYINDEX, userdata);
+    const char* outer = script_callback;
+    script_callback = name;
     if (lua_pcall(context, 1, 0, 0) != LUA_OK)
         log_fatal(src_basename(filename), line, "Error from \"%s\": %s", name, lua_tostring(context, -1));
+    script_callback = outer;
 }
 
 void _execute_ref_in_child(int ref, int userdata, int userdata2, const char* name, const char* filename, int line) {
     lua_rawgeti(context, LUA_REGISTRYINDEX, ref);
     lua_rawgeti(context, LUA_REGISTRYINDEX, userdata);
     lua_rawgeti(context, LUA_REGISTRYINDEX, userdata2);
+    const char* outer = script_callback;
+    script_callback = name;
     if (lua_pcall(context, 2, 0, 0) != LUA_OK)
         log_fatal(src_basename(filename), line, "Error from \"%s\": %s", name, lua_tostring(context, -1));
+    script_callback = outer;
 }
 
 lua_Debug* script_stack_trace(lua_State* L) {
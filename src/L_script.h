@@ -10,6 +10,11 @@
 #define SCRIPT_PUSH(type) lua_push##type
 #define SCRIPT_TO(type) lua_to##type
 
+#define SCRIPT_SMALL_SIZE 256  // Lua blocks up to this size come from size class pools
+#define SCRIPT_SIZE_CLASS 16   // Size class granularity, same as POOL_ALIGN
+#define SCRIPT_SLAB_SIZE 16384 // Bytes per size class slab
+#define SCRIPT_SIZE_CLASSES (SCRIPT_SMALL_SIZE / SCRIPT_SIZE_CLASS)
+
 #define EXPOSE_PACKAGE(name, function)                                                                                 \
     luaL_requiref(context, name, function, 1);                                                                         \
     lua_pop(context, 1);
@@ -158,8 +163,7 @@
     }                                                                                                                  \
                                                                                                                        \
     SCRIPT_FUNCTION(fetch_##typename) {                                                                                \
-        const char* name = luaL_checkstring(L, 1);                                                                     \
-        const assettype asset = fetch_##typename(name);                                                                \
+        const assettype asset = fetch_##typename##_atom(s_check_atom(L, 1));                                           \
         if (asset == NULL)                                                                                             \
             lua_pushnil(L);                                                                                            \
         else                                                                                                           \
@@ -168,8 +172,7 @@
     }                                                                                                                  \
                                                                                                                        \
     SCRIPT_FUNCTION(get_##typename) {                                                                                  \
-        const char* name = luaL_checkstring(L, 1);                                                                     \
-        const assettype asset = get_##typename(name);                                                                  \
+        const assettype asset = get_##typename##_atom(s_check_atom(L, 1));                                             \
         if (asset == NULL)                                                                                             \
             lua_pushnil(L);                                                                                            \
         else                                                                                                           \
@@ -216,6 +219,7 @@ void set_import_path(const char*);
 void _execute_buffer(void*, size_t, const char*, const char*, int);
 
 void collect_garbage();
+void log_script_memory();
 void* userdata_alloc(const char*, size_t);
 void* _userdata_alloc_clean(const char*, size_t, const char*, int);
 
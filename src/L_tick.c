@@ -9,20 +9,35 @@
 #include "L_ui.h"
 #include "L_video.h"
 
+#define TICK_NS (SDL_NS_PER_SECOND / TICKRATE)
+
 static uint64_t last_time = 0;
-static float ticks = 0;
+static float ticks = 0, tick_scale = 1;
+static uint64_t world_ticks = 0; // Ticks where the world actually ran
+static bool world_ticking = false;
 
 void tick_init() {
-    last_time = SDL_GetTicks();
+    last_time = SDL_GetTicksNS();
 
     INFO("Opened");
 }
 
+// Scripts read the actor's own draw state, so it's lerped on the CPU even
+// when models are blended on the GPU
+static void interpolate_actor(struct Actor* actor) {
+    glm_vec3_lerp(actor->draw_pos[0], actor->pos, ticks, actor->draw_pos[1]);
+    actor->draw_angle[1][0] = glm_lerp(actor->draw_angle[0][0], actor->angle[0], ticks);
+    actor->draw_angle[1][1] = glm_lerp(actor->draw_angle[0][1], actor->angle[1], ticks);
+    actor->draw_angle[1][2] = glm_lerp(actor->draw_angle[0][2], actor->angle[2], ticks);
+}
+
 void tick_update() {
-    const uint64_t current_time = SDL_GetTicks();
-    ticks += (float)(current_time - last_time) * ((float)TICKRATE / 1000.0f);
+    lame_frame_reset();
+    const uint64_t current_time = SDL_GetTicksNS();
+    ticks += ((float)(current_time - last_time) / (float)TICK_NS) * tick_scale;
 
-    if (ticks >= 1) {
+    const bool ticked = ticks >= 1;
+    if (ticked) {
         if (get_load_state() == LOAD_NONE) {
             // Pre-interpolation
             struct Actor* actor = get_actors();
@@ -58,6 +73,7 @@ void tick_update() {
 
             while (ticks >= 1) {
                 bool tick_world = true;
+                tick_allocations();
 
                 // UI
                 struct UI* ui_top = get_ui_top();
@@ -183,6 +199,9 @@ void tick_update() {
                 }
 
                 input_clear_momentary();
+                if (tick_world)
+                    world_ticks++;
+                world_ticking = tick_world;
                 if (get_load_state() != LOAD_NONE) {
                     ticks -= SDL_floorf(ticks);
                     break;
@@ -195,11 +214,20 @@ void tick_update() {
     }
 
     // Post-interpolation
+    // With GPU interpolation, the current state only has to be copied once
+    // per tick. Models are blended in the shader, cameras and lights right
+    // before rendering. Actors themselves are still lerped every frame.
     struct Actor* actor = get_actors();
-    if (get_framerate() <= TICKRATE) {
+    const bool gpu_interpolation = get_gpu_interpolation();
+    const bool snap = get_framerate() <= TICKRATE || (gpu_interpolation && ticked);
+    if (snap) {
         while (actor != NULL) {
-            glm_vec3_copy(actor->pos, actor->draw_pos[1]);
-            glm_vec3_copy(actor->angle, actor->draw_angle[1]);
+            if (gpu_interpolation) {
+                interpolate_actor(actor);
+            } else {
+                glm_vec3_copy(actor->pos, actor->draw_pos[1]);
+                glm_vec3_copy(actor->angle, actor->draw_angle[1]);
+            }
 
             struct ActorCamera* camera = actor->camera;
             if (camera != NULL) {
@@ -227,12 +255,9 @@ void tick_update() {
 
             actor = actor->previous;
         }
-    } else {
+    } else if (!gpu_interpolation) {
         while (actor != NULL) {
-            glm_vec3_lerp(actor->draw_pos[0], actor->pos, ticks, actor->draw_pos[1]);
-            actor->draw_angle[1][0] = glm_lerp(actor->draw_angle[0][0], actor->angle[0], ticks);
-            actor->draw_angle[1][1] = glm_lerp(actor->draw_angle[0][1], actor->angle[1], ticks);
-            actor->draw_angle[1][2] = glm_lerp(actor->draw_angle[0][2], actor->angle[2], ticks);
+            interpolate_actor(actor);
 
             struct ActorCamera* camera = actor->camera;
             if (camera != NULL) {
@@ -264,10 +289,19 @@ void tick_update() {
                         dq_lerp(model->draw_sample[0][i], model->sample[i], ticks, model->draw_sample[1][i]);
             }
 
+            actor = actor->previous;
+        }
+    } else {
+        while (actor != NULL) {
+            interpolate_actor(actor);
             actor = actor->previous;
         }
     }
 
+    // Rebuild matrices and palettes only when the draw state changed
+    if (snap || !gpu_interpolation)
+        video_prepare();
+
     last_time = current_time;
 }
 
@@ -276,10 +310,25 @@ void tick_teardown() {
 }
 
 void reset_ticks() {
-    last_time = SDL_GetTicks();
+    last_time = SDL_GetTicksNS();
     ticks = 0;
 }
 
 float get_ticks() {
     return ticks;
 }
+
+// Interpolated world time in ticks, stands still while the world is paused or frozen
+float get_world_ticks() {
+    return (float)world_ticks + (world_ticking ? SDL_min(ticks, 1) : 0);
+}
+
+uint64_t get_next_tick_time() {
+    if (tick_scale <= 0)
+        return SDL_MAX_UINT64;
+    return last_time + (uint64_t)((SDL_max(1 - ticks, 0) * (float)TICK_NS) / tick_scale);
+}
+
+void set_tick_scale(float scale) {
+    tick_scale = SDL_clamp(scale, 0, 1);
+}
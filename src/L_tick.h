@@ -8,3 +8,6 @@ void tick_teardown();
 
 void reset_ticks();
 float get_ticks();
+float get_world_ticks();
+uint64_t get_next_tick_time();
+void set_tick_scale(float);
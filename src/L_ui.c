@@ -22,9 +22,9 @@ void ui_teardown() {
     if (ui_root != NULL)
         destroy_ui(ui_root);
 
-    for (size_t i = 0; ui_types->count > 0 && i < ui_types->capacity; i++) {
+    for (size_t i = 0; i < ui_types->capacity; i++) {
         struct KeyValuePair* kvp = &ui_types->items[i];
-        if (kvp->key == NULL || kvp->key == HASH_TOMBSTONE)
+        if (kvp->key == NULL)
             continue;
 
         struct UIType* type = kvp->value;
@@ -37,11 +37,6 @@ void ui_teardown() {
             unreference(&(type->draw));
             lame_free(&(kvp->value));
         }
-
-        lame_free(&(kvp->key));
-        kvp->key = HASH_TOMBSTONE;
-
-        ui_types->count--;
     }
 
     destroy_hash_map(ui_types, false);
@@ -158,7 +153,7 @@ struct UI* create_ui(struct UI* parent, const char* name) {
     ui->userdata = create_pointer_ref("ui", ui);
 
     if (type->create != LUA_NOREF)
-        execute_ref_in(type->create, ui->userdata, name);
+        execute_ref_in(type->create, ui->userdata, type->name);
 
     if (hid_to_ui(hid) != NULL) {
         if (ui_blocking())
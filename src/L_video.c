@@ -1,3 +1,6 @@
+#include <SDL3/SDL_atomic.h>
+#include <SDL3/SDL_mutex.h>
+#include <SDL3/SDL_thread.h>
 #include <SDL3/SDL_timer.h>
 
 #include "L_actor.h"
@@ -7,6 +10,7 @@
 #include "L_log.h"
 #include "L_memory.h"
 #include "L_player.h"
+#include "L_tick.h"
 #include "L_ui.h"
 #include "L_video.h"
 
@@ -14,17 +18,116 @@ static SDL_Window* window = NULL;
 static SDL_GLContext gpu = NULL;
 
 static struct Display display = {DEFAULT_DISPLAY_WIDTH, DEFAULT_DISPLAY_HEIGHT, 0};
-static uint16_t framerate = 0;
-static uint64_t last_cap_time = 0;
-static float cap_wait = 0;
+static uint16_t framerate = 0, background_framerate = 0;
+static bool background = false, minimized = false;
+static uint64_t next_frame_time = 0;
 static uint64_t draw_time = 0;
 
+static uint8_t frame_latency = 0;
+static size_t frame_index = 0;
+static GLsync frame_fences[MAX_FRAME_LATENCY] = {NULL};
+static void clear_frame_fences();
+
+static bool threaded = false, presenting = false;
+static SDL_Thread* present_thread = NULL;
+static SDL_Semaphore *present_ready = NULL, *present_done = NULL;
+static SDL_AtomicInt present_quit = {0};
+
 static GLuint blank_texture = 0;
+static bool s3tc_supported = false; // Queried once, textures can be loaded mid-tick without the context
+
+// Bumped whenever the tick changes what gets drawn, so matrices and palettes
+// are only rebuilt once per tick with GPU interpolation.
+static uint64_t draw_count = 0;
+static GLfloat previous_weight = 0;
+
+// Skinning palettes for every animated model instance in the current draw
+// state, sampled through a texture buffer.
+static GLuint palette_buffer = 0, palette_texture = 0;
+static DualQuaternion* palette = NULL;
+static size_t palette_count = 0, palette_capacity = 0, palette_uploaded = 0, palette_gpu_capacity = 0;
+
+static struct Pool* model_instance_pool = NULL;
+
+// The present thread owns the context between frames, so GL work asked for
+// during the tick waits for the next video_update()
+static GLuint* gl_garbage[GLG_SIZE] = {NULL};
+static size_t gl_garbage_count[GLG_SIZE] = {0}, gl_garbage_capacity[GLG_SIZE] = {0};
+
+struct PendingOverride {
+    struct ModelInstance* inst;
+    size_t material;
+    struct Texture* texture;
+    struct Surface* surface;
+};
+static struct PendingOverride* pending_overrides = NULL;
+static size_t num_pending_overrides = 0, pending_overrides_capacity = 0;
+
+// Visible ranges for static batches
+static GLint* batch_firsts = NULL;
+static GLsizei* batch_counts = NULL;
+static size_t batch_capacity = 0;
+static vec3 batch_eye = GLM_VEC3_ZERO_INIT;
+
+// Distance that textures get requested at, for streaming
+static float stream_distance = 0;
+
+// Uniform names are interned once, so setting one is a pointer lookup
+#define UNIFORMS(X)                                                                                                    \
+    X(u_alpha_test)                                                                                                    \
+    X(u_ambient)                                                                                                       \
+    X(u_animated)                                                                                                      \
+    X(u_blend_texture)                                                                                                 \
+    X(u_bright)                                                                                                        \
+    X(u_cel)                                                                                                           \
+    X(u_color)                                                                                                         \
+    X(u_crowd)                                                                                                         \
+    X(u_crowd_frames)                                                                                                  \
+    X(u_crowd_time)                                                                                                    \
+    X(u_depth_only)                                                                                                    \
+    X(u_fog_color)                                                                                                     \
+    X(u_fog_distance)                                                                                                  \
+    X(u_half_lambert)                                                                                                  \
+    X(u_has_blend_texture)                                                                                             \
+    X(u_has_lightmap)                                                                                                  \
+    X(u_lightmap)                                                                                                      \
+    X(u_material_wind)                                                                                                 \
+    X(u_model_matrix)                                                                                                  \
+    X(u_mvp_matrix)                                                                                                    \
+    X(u_palette)                                                                                                       \
+    X(u_palette_offset)                                                                                                \
+    X(u_previous_model_matrix)                                                                                         \
+    X(u_previous_palette_offset)                                                                                       \
+    X(u_previous_weight)                                                                                               \
+    X(u_projection_matrix)                                                                                             \
+    X(u_scroll)                                                                                                        \
+    X(u_specular)                                                                                                      \
+    X(u_stencil)                                                                                                       \
+    X(u_texture)                                                                                                       \
+    X(u_time)                                                                                                          \
+    X(u_view_matrix)                                                                                                   \
+    X(u_wind)
+#define DEFINE_UNIFORM(name) static Atom name = NULL;
+#define INTERN_UNIFORM(name) name = intern(#name);
+UNIFORMS(DEFINE_UNIFORM)
+static Atom u_lights = NULL; // First element of the array, "u_lights[0]"
+
+static void push_palette(struct ModelInstance*);
+static void collect_gl_garbage();
+static void flush_pending_overrides();
+static void drop_pending_overrides(struct ModelInstance*, struct Surface*);
+static void upload_palette();
+static void count_draw(size_t);
+static void flush_batch(enum RenderStats);
+static void roll_render_stats();
+static void build_matrix(mat4, vec3, vec3, vec3);
 
 static enum RenderTypes render_stage = RT_MAIN;
 static struct MainBatch main_batch = {0};
 static struct WorldBatch world_batch = {0};
 static struct ActorCamera* active_camera = NULL;
+static bool depth_prepass = false;
+static bool gpu_interpolation = false;
 
 static struct Shader* default_shaders[RT_SIZE] = {NULL};
 static struct Shader* sky_shader = NULL;
@@ -32,6 +135,40 @@ static struct Shader* current_shader = NULL;
 static struct Font* default_font = NULL;
 static struct Surface* current_surface = NULL;
 
+// Redundant state changes get skipped, see bind_texture() and friends
+static GLuint samplers[ST_SIZE] = {0};
+static GLuint active_unit = 0;
+static GLenum bound_targets[MAX_CACHED_TEXTURE_UNITS] = {0};
+static GLuint bound_textures[MAX_CACHED_TEXTURE_UNITS] = {0};
+static GLuint bound_samplers[MAX_CACHED_TEXTURE_UNITS] = {0};
+static GLuint bound_vertex_array = 0, bound_array_buffer = 0;
+static GLenum blend_func[4] = {0};
+static uint8_t capabilities = 0, capabilities_known = 0;
+static uint64_t avoided_gl_calls[SC_SIZE] = {0};
+
+// Every GL allocation by name, see track_texture() and track_buffer()
+struct GPUAllocation {
+    enum GPUMemoryTypes type;
+    size_t size;
+    char* owner;
+};
+
+static struct IntMap *gpu_textures = NULL, *gpu_buffers = NULL;
+static size_t gpu_memory[GMT_SIZE] = {0};
+
+// Per-frame counters and a window of past frames for averages
+static uint64_t render_stats[RS_SIZE] = {0}, last_render_stats[RS_SIZE] = {0};
+static uint64_t render_history[RENDER_STATS_WINDOW][RS_SIZE] = {0}, render_sums[RS_SIZE] = {0};
+static size_t render_frames = 0;
+static bool log_render_stats = false;
+static const char* render_stat_names[RS_SIZE] = {
+    "draw_calls", "vertices",      "flushes",  "texture_flushes", "shader_flushes", "overflow_flushes",
+    "uniforms",   "texture_binds", "surfaces", "actors_drawn",    "actors_culled",  "draw_callbacks",
+};
+static const char* gpu_memory_names[GMT_SIZE] = {
+    "textures", "models", "surfaces", "batches", "palette", "crowds", "staging",
+};
+
 static mat4 forward_axis = GLM_MAT4_IDENTITY_INIT;
 static mat4 up_axis = GLM_MAT4_IDENTITY_INIT;
 
@@ -41,6 +178,9 @@ static mat4 projection_matrix = GLM_MAT4_IDENTITY_INIT;
 static mat4 mvp_matrix = GLM_MAT4_IDENTITY_INIT;
 
 void video_init(bool bypass_shader) {
+    UNIFORMS(INTERN_UNIFORM)
+    u_lights = intern("u_lights[0]");
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -59,6 +199,7 @@ void video_init(bool bypass_shader) {
     SDL_GL_SetSwapInterval(0);
 
     update_display();
+    update_present_thread();
 
     int version = gladLoadGL((GLADloadfunc)SDL_GL_GetProcAddress);
     if (version == 0)
@@ -81,15 +222,34 @@ void video_init(bool bypass_shader) {
     INFO("OpenGL version: %s", glGetString(GL_VERSION));
     INFO("OpenGL renderer: %s", glGetString(GL_RENDERER));
     INFO("OpenGL shading language version: %s", glGetString(GL_SHADING_LANGUAGE_VERSION));
+    s3tc_supported = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc");
+
+    model_instance_pool = create_pool("model instances", sizeof(struct ModelInstance), MODEL_INSTANCE_POOL_SIZE);
+
+    // Samplers
+    invalidate_gl_state();
+    gpu_textures = create_int_map();
+    gpu_buffers = create_int_map();
+
+    glGenSamplers(ST_SIZE, samplers);
+    glSamplerParameteri(samplers[ST_NEAREST], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(samplers[ST_NEAREST], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(samplers[ST_LINEAR], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(samplers[ST_LINEAR], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(samplers[ST_MIP_NEAREST], GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glSamplerParameteri(samplers[ST_MIP_NEAREST], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glSamplerParameteri(samplers[ST_MIP_LINEAR], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(samplers[ST_MIP_LINEAR], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // Blank texture
     glGenTextures(1, &blank_texture);
-    glBindTexture(GL_TEXTURE_2D, blank_texture);
+    bind_texture(0, GL_TEXTURE_2D, blank_texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, (const uint8_t[]){255, 255, 255, 255});
+    track_texture(blank_texture, GMT_TEXTURE, "blank", 4);
 
     // Main batch
     glGenVertexArrays(1, &main_batch.vao);
-    glBindVertexArray(main_batch.vao);
+    bind_vertex_array(main_batch.vao);
     glEnableVertexArrayAttrib(main_batch.vao, VATT_POSITION);
     glVertexArrayAttribFormat(main_batch.vao, VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
     glEnableVertexArrayAttrib(main_batch.vao, VATT_COLOR);
@@ -102,10 +262,11 @@ void video_init(bool bypass_shader) {
     main_batch.vertices = lame_alloc(main_batch.vertex_capacity * sizeof(struct MainVertex));
 
     glGenBuffers(1, &main_batch.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, main_batch.vbo);
+    bind_array_buffer(main_batch.vbo);
     glBufferData(
         GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct MainVertex) * main_batch.vertex_capacity), NULL, GL_DYNAMIC_DRAW
     );
+    track_buffer(main_batch.vbo, GMT_BATCH, "main", sizeof(struct MainVertex) * main_batch.vertex_capacity);
 
     glEnableVertexAttribArray(VATT_POSITION);
     glVertexAttribPointer(
@@ -138,7 +299,7 @@ void video_init(bool bypass_shader) {
 
     // World batch
     glGenVertexArrays(1, &world_batch.vao);
-    glBindVertexArray(world_batch.vao);
+    bind_vertex_array(world_batch.vao);
     glEnableVertexArrayAttrib(world_batch.vao, VATT_POSITION);
     glVertexArrayAttribFormat(world_batch.vao, VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
     glEnableVertexArrayAttrib(world_batch.vao, VATT_NORMAL);
@@ -157,10 +318,11 @@ void video_init(bool bypass_shader) {
     world_batch.vertices = lame_alloc(world_batch.vertex_capacity * sizeof(struct WorldVertex));
 
     glGenBuffers(1, &world_batch.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, world_batch.vbo);
+    bind_array_buffer(world_batch.vbo);
     glBufferData(
         GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct WorldVertex) * world_batch.vertex_capacity), NULL, GL_DYNAMIC_DRAW
     );
+    track_buffer(world_batch.vbo, GMT_BATCH, "world", sizeof(struct WorldVertex) * world_batch.vertex_capacity);
 
     glEnableVertexAttribArray(VATT_POSITION);
     glVertexAttribPointer(
@@ -208,7 +370,21 @@ void video_init(bool bypass_shader) {
 
     world_batch.filter = true;
 
-    glEnable(GL_BLEND);
+    // Skinning palette
+    palette_capacity = PALETTE_CAPACITY;
+    palette = lame_alloc(palette_capacity * sizeof(DualQuaternion));
+
+    glGenBuffers(1, &palette_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, palette_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(palette_capacity * sizeof(DualQuaternion)), NULL, GL_STREAM_DRAW);
+    palette_gpu_capacity = palette_capacity;
+    track_buffer(palette_buffer, GMT_PALETTE, "skinning", palette_gpu_capacity * sizeof(DualQuaternion));
+
+    glGenTextures(1, &palette_texture);
+    bind_texture(PALETTE_TEXTURE_UNIT, GL_TEXTURE_BUFFER, palette_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, palette_buffer);
+
+    set_capability(GL_BLEND, true);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
@@ -248,15 +424,40 @@ void video_init(bool bypass_shader) {
 }
 
 void video_update() {
+    lame_frame_reset();
+    collect_gl_garbage();
+    flush_pending_overrides();
+
     draw_time = SDL_GetTicks();
-    if (framerate > 0) {
-        cap_wait += (float)(draw_time - last_cap_time) * ((float)framerate / 1000.0f);
-        last_cap_time = draw_time;
-        if (cap_wait < 1)
+    const uint16_t fps = get_framerate();
+    if (fps > 0) {
+        const uint64_t now = SDL_GetTicksNS();
+        if (now < next_frame_time)
             return;
-        cap_wait -= SDL_floorf(cap_wait);
-    } else {
-        last_cap_time = draw_time;
+
+        // Don't try to catch up after a hitch
+        const uint64_t frame_ns = SDL_NS_PER_SECOND / fps;
+        next_frame_time += frame_ns;
+        if (next_frame_time <= now)
+            next_frame_time = now + frame_ns;
+    }
+
+    roll_render_stats();
+    update_textures(false);
+
+    // Matrices and palettes were gathered in video_prepare(), only the
+    // interpolation factor changes between ticks
+    upload_palette();
+    previous_weight = 1 - get_ticks();
+
+    // Don't let the GPU queue up more than "frame_latency" frames
+    if (frame_latency > 0) {
+        GLsync* fence = &frame_fences[frame_index % frame_latency];
+        if (*fence != NULL) {
+            glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(*fence);
+            *fence = NULL;
+        }
     }
 
     set_surface(NULL);
@@ -292,7 +493,7 @@ void video_update() {
                 player = player->previous_active;
             }
         }
-        if (camera != NULL) {
+        if (camera != NULL && !minimized) {
             struct Surface* surface = render_camera(camera, display.width, display.height, true, NULL, 0);
             glBindFramebuffer(GL_READ_FRAMEBUFFER, surface->fbo);
             glBlitFramebuffer(
@@ -306,8 +507,10 @@ void video_update() {
             if (player->room != NULL && player->room->master == player) {
                 struct Actor* actor = player->room->actors;
                 while (actor != NULL) {
-                    if ((actor->flags & AF_VISIBLE) && actor->type->draw_ui != LUA_NOREF)
+                    if ((actor->flags & AF_VISIBLE) && actor->type->draw_ui != LUA_NOREF) {
                         execute_ref_in(actor->type->draw_ui, actor->userdata, actor->type->name);
+                        render_stats[RS_DRAW_CALLBACKS]++;
+                    }
                     actor = actor->previous_neighbor;
                 }
             }
@@ -315,31 +518,216 @@ void video_update() {
         }
 
         const struct UI* ui_top = get_ui_top();
-        if (ui_top != NULL && ui_top->type->draw != LUA_NOREF)
+        if (ui_top != NULL && ui_top->type->draw != LUA_NOREF) {
             execute_ref_in(ui_top->type->draw, ui_top->userdata, ui_top->type->name);
+            render_stats[RS_DRAW_CALLBACKS]++;
+        }
     }
 
     submit_main_batch();
 
-    // If Steam Overlay hooks on to the application, MSVC debugger may cause a
-    // breakpoint here. Otherwise the program itself runs without a problem.
-    SDL_GL_SwapWindow(window);
+    if (frame_latency > 0)
+        frame_fences[frame_index++ % frame_latency] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    if (present_thread != NULL) {
+        // Hand the context over to the present thread, we get it back in
+        // video_sync()
+        glFlush();
+        SDL_GL_MakeCurrent(window, NULL);
+        presenting = true;
+        SDL_SignalSemaphore(present_ready);
+    } else {
+        // If Steam Overlay hooks on to the application, MSVC debugger may cause
+        // a breakpoint here. Otherwise the program itself runs without a
+        // problem.
+        SDL_GL_SwapWindow(window);
+    }
+}
+
+void video_prepare() {
+    draw_count++;
+    palette_count = palette_uploaded = 0;
+
+    struct Actor* actor = get_actors();
+    while (actor != NULL) {
+        if (actor->model != NULL) {
+            update_model_instance_matrix(actor->model);
+            push_palette(actor->model);
+        }
+        actor = actor->previous;
+    }
+}
+
+void video_sync() {
+    if (!presenting)
+        return;
+    SDL_WaitSemaphore(present_done);
+    if (!SDL_GL_MakeCurrent(window, gpu))
+        FATAL("Failed to reclaim GPU from present thread: %s", SDL_GetError());
+    presenting = false;
+}
+
+static void delete_gl_names_now(enum GLGarbageTypes type, GLsizei n, const GLuint* names) {
+    switch (type) {
+        default:
+            break;
+        case GLG_TEXTURE:
+            glDeleteTextures(n, names);
+            break;
+        case GLG_BUFFER:
+            glDeleteBuffers(n, names);
+            break;
+        case GLG_VERTEX_ARRAY:
+            glDeleteVertexArrays(n, names);
+            break;
+        case GLG_FRAMEBUFFER:
+            glDeleteFramebuffers(n, names);
+            break;
+    }
+    invalidate_gl_state();
+}
+
+// Names can't be reused until they're deleted, so holding on to them is safe
+static void delete_gl_names(enum GLGarbageTypes type, GLsizei n, const GLuint* names) {
+    if (!presenting) {
+        delete_gl_names_now(type, n, names);
+        return;
+    }
+
+    const size_t count = gl_garbage_count[type] + (size_t)n;
+    if (count > gl_garbage_capacity[type]) {
+        size_t capacity = SDL_max(gl_garbage_capacity[type], 16);
+        while (count > capacity)
+            capacity *= 2;
+        if (gl_garbage[type] == NULL)
+            gl_garbage[type] = lame_alloc(capacity * sizeof(GLuint));
+        else
+            lame_realloc(&gl_garbage[type], capacity * sizeof(GLuint));
+        gl_garbage_capacity[type] = capacity;
+    }
+    lame_copy(&gl_garbage[type][gl_garbage_count[type]], names, (size_t)n * sizeof(GLuint));
+    gl_garbage_count[type] = count;
+}
+
+static void collect_gl_garbage() {
+    for (size_t i = 0; i < GLG_SIZE; i++)
+        if (gl_garbage_count[i] > 0) {
+            delete_gl_names_now((enum GLGarbageTypes)i, (GLsizei)gl_garbage_count[i], gl_garbage[i]);
+            gl_garbage_count[i] = 0;
+        }
+}
+
+static void apply_override(const struct PendingOverride* override) {
+    GLuint texture = 0;
+    if (override->texture != NULL) {
+        finish_texture(override->texture); // Overrides store the GL name directly
+        texture = override->texture->texture;
+    } else if (override->surface != NULL) {
+        validate_surface(override->surface);
+        texture = override->surface->texture[SURFACE_COLOR_TEXTURE];
+    }
+    override->inst->override_textures[override->material] = texture;
+}
+
+static void flush_pending_overrides() {
+    for (size_t i = 0; i < num_pending_overrides; i++)
+        apply_override(&pending_overrides[i]);
+    num_pending_overrides = 0;
+}
+
+// Pass either to forget everything that refers to it
+static void drop_pending_overrides(struct ModelInstance* inst, struct Surface* surface) {
+    for (size_t i = 0; i < num_pending_overrides;) {
+        const struct PendingOverride* override = &pending_overrides[i];
+        if ((inst != NULL && override->inst == inst) || (surface != NULL && override->surface == surface))
+            pending_overrides[i] = pending_overrides[--num_pending_overrides];
+        else
+            i++;
+    }
+}
+
+// Texture and surface overrides need their GL names, so they wait for the
+// context if the present thread has it
+static void override_texture(
+    struct ModelInstance* inst, size_t material, struct Texture* texture, struct Surface* surface
+) {
+    const struct PendingOverride override = {inst, material, texture, surface};
+
+    size_t i = 0;
+    while (i < num_pending_overrides &&
+           (pending_overrides[i].inst != inst || pending_overrides[i].material != material))
+        i++;
+
+    if (!presenting) {
+        if (i < num_pending_overrides)
+            pending_overrides[i] = pending_overrides[--num_pending_overrides];
+        apply_override(&override);
+        return;
+    }
+
+    if (i >= num_pending_overrides) {
+        if (num_pending_overrides >= pending_overrides_capacity) {
+            pending_overrides_capacity = SDL_max(pending_overrides_capacity * 2, 8);
+            if (pending_overrides == NULL)
+                pending_overrides = lame_alloc(pending_overrides_capacity * sizeof(struct PendingOverride));
+            else
+                lame_realloc(&pending_overrides, pending_overrides_capacity * sizeof(struct PendingOverride));
+        }
+        num_pending_overrides++;
+    }
+    pending_overrides[i] = override;
 }
 
 void video_teardown() {
+    threaded = false;
+    update_present_thread();
+
+    collect_gl_garbage();
+    for (size_t i = 0; i < GLG_SIZE; i++)
+        FREE_POINTER(gl_garbage[i]);
+    FREE_POINTER(pending_overrides);
+    num_pending_overrides = pending_overrides_capacity = 0;
+
+    clear_frame_fences();
+    untrack_texture(blank_texture);
     glDeleteTextures(1, &blank_texture);
+    glDeleteSamplers(ST_SIZE, samplers);
+
+    glDeleteTextures(1, &palette_texture);
+    untrack_buffer(palette_buffer);
+    glDeleteBuffers(1, &palette_buffer);
+    lame_free(&palette);
+    FREE_POINTER(batch_firsts);
+    FREE_POINTER(batch_counts);
+    batch_capacity = 0;
 
     glDeleteVertexArrays(1, &main_batch.vao);
+    untrack_buffer(main_batch.vbo);
     glDeleteBuffers(1, &main_batch.vbo);
     lame_free(&main_batch.vertices);
 
     glDeleteVertexArrays(1, &world_batch.vao);
+    untrack_buffer(world_batch.vbo);
     glDeleteBuffers(1, &world_batch.vbo);
     lame_free(&world_batch.vertices);
 
+    // Everything else should be gone by now
+    if (get_gpu_memory_total() > 0) {
+        WARN("Leaked %zu bytes of GPU memory", get_gpu_memory_total());
+        dump_gpu_memory();
+    }
+    CLOSE_POINTER(gpu_textures, clear_gpu_memory);
+    CLOSE_POINTER(gpu_buffers, clear_gpu_memory);
+    CLOSE_POINTER(model_instance_pool, destroy_pool);
+
     CLOSE_POINTER(gpu, SDL_GL_DestroyContext);
     CLOSE_POINTER(window, SDL_DestroyWindow);
 
+    uint64_t avoided = 0;
+    for (size_t i = 0; i < SC_SIZE; i++)
+        avoided += avoided_gl_calls[i];
+    INFO("Avoided %" SDL_PRIu64 " redundant GL calls", avoided);
+
     INFO("Closed");
 }
 
@@ -369,6 +757,8 @@ void set_display(int width, int height, enum FullscreenModes fullscreen, bool vs
 void update_display() {
     if (window == NULL || gpu == NULL)
         return;
+    video_sync();
+
     // MEMORY LEAK: In exclusive fullscreen, Windows will leak ~220 bytes every
     //              time you tab out and back in.
     //              https://github.com/libsdl-org/SDL/issues/13233
@@ -389,13 +779,19 @@ void update_display() {
     }*/
     SDL_SetWindowFullscreen(window, display.fullscreen != FSM_WINDOWED);
     SDL_SetWindowSize(window, display.width, display.height);
-    SDL_GL_SetSwapInterval(display.vsync);
+    // Prefer adaptive vsync so missed frames tear instead of stalling
+    if (!display.vsync)
+        SDL_GL_SetSwapInterval(0);
+    else if (!SDL_GL_SetSwapInterval(-1))
+        SDL_GL_SetSwapInterval(1);
     SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
     SDL_RestoreWindow(window);
     SDL_SyncWindow(window);
 }
 
 uint16_t get_framerate() {
+    if (background && background_framerate > 0 && (framerate <= 0 || background_framerate < framerate))
+        return background_framerate;
     return framerate;
 }
 
@@ -407,100 +803,469 @@ void set_framerate(uint16_t fps) {
         INFO("Capped framerate to %d FPS", fps);
     else
         INFO("Uncapped framerate");
+    next_frame_time = 0;
+}
+
+static void clear_frame_fences() {
+    for (size_t i = 0; i < MAX_FRAME_LATENCY; i++)
+        CLOSE_POINTER(frame_fences[i], glDeleteSync);
+}
+
+void set_background_framerate(uint16_t fps) {
+    if (background_framerate == fps)
+        return;
+    background_framerate = fps;
+    if (background_framerate > 0)
+        INFO("Capped background framerate to %d FPS", fps);
+    else
+        INFO("Uncapped background framerate");
+}
+
+uint64_t get_next_frame_time() {
+    return get_framerate() > 0 ? next_frame_time : 0;
+}
+
+void set_frame_latency(uint8_t frames) {
+    frames = SDL_min(frames, MAX_FRAME_LATENCY);
+    if (frame_latency == frames)
+        return;
+
+    clear_frame_fences();
+    frame_latency = frames;
+    frame_index = 0;
+
+    if (frame_latency > 0)
+        INFO("Limited frame latency to %d frames", frames);
+    else
+        INFO("Unlimited frame latency");
+}
+
+static int present_loop(void* data) {
+    while (true) {
+        SDL_WaitSemaphore(present_ready);
+        if (SDL_GetAtomicInt(&present_quit))
+            break;
+
+        SDL_GL_MakeCurrent(window, gpu);
+        SDL_GL_SwapWindow(window);
+        SDL_GL_MakeCurrent(window, NULL);
+        SDL_SignalSemaphore(present_done);
+    }
+
+    return 0;
+}
+
+void update_present_thread() {
+    if (window == NULL || gpu == NULL)
+        return;
+
+    if (threaded && present_thread == NULL) {
+        present_ready = SDL_CreateSemaphore(0);
+        present_done = SDL_CreateSemaphore(0);
+        if (present_ready == NULL || present_done == NULL)
+            FATAL("Present semaphore fail: %s", SDL_GetError());
+        SDL_SetAtomicInt(&present_quit, 0);
+
+        present_thread = SDL_CreateThread(present_loop, "present", NULL);
+        if (present_thread == NULL)
+            FATAL("Present thread fail: %s", SDL_GetError());
+        INFO("Presenting on a separate thread");
+    } else if (!threaded && present_thread != NULL) {
+        video_sync();
+        SDL_SetAtomicInt(&present_quit, 1);
+        SDL_SignalSemaphore(present_ready);
+        SDL_WaitThread(present_thread, NULL);
+        present_thread = NULL;
+
+        CLOSE_POINTER(present_ready, SDL_DestroySemaphore);
+        CLOSE_POINTER(present_done, SDL_DestroySemaphore);
+        INFO("Presenting on main thread");
+    }
+}
+
+void set_present_thread(bool enabled) {
+    if (threaded == enabled)
+        return;
+    threaded = enabled;
+    update_present_thread();
 }
 
 uint64_t get_draw_time() {
     return draw_time;
 }
 
+static void count_draw(size_t vertices) {
+    render_stats[RS_DRAW_CALLS]++;
+    render_stats[RS_VERTICES] += vertices;
+}
+
+// Move this frame's counters into the rolling window and start over
+static void roll_render_stats() {
+    uint64_t* slot = render_history[render_frames % RENDER_STATS_WINDOW];
+    for (size_t i = 0; i < RS_SIZE; i++) {
+        render_sums[i] += render_stats[i] - slot[i];
+        slot[i] = last_render_stats[i] = render_stats[i];
+        render_stats[i] = 0;
+    }
+    render_frames++;
+
+    if (!log_render_stats || (render_frames % RENDER_STATS_WINDOW) != 0)
+        return;
+    INFO(
+        "Render stats (%d frame average): %.1f draw calls, %.1f vertices, %.1f flushes (%.1f texture, %.1f shader, "
+        "%.1f overflow), %.1f uniforms, %.1f texture binds, %.1f surfaces, %.1f/%.1f actors drawn/culled, %.1f "
+        "draw callbacks",
+        RENDER_STATS_WINDOW, get_render_stat_average(RS_DRAW_CALLS), get_render_stat_average(RS_VERTICES),
+        get_render_stat_average(RS_FLUSHES), get_render_stat_average(RS_TEXTURE_FLUSHES),
+        get_render_stat_average(RS_SHADER_FLUSHES), get_render_stat_average(RS_OVERFLOW_FLUSHES),
+        get_render_stat_average(RS_UNIFORMS), get_render_stat_average(RS_TEXTURE_BINDS),
+        get_render_stat_average(RS_SURFACES), get_render_stat_average(RS_ACTORS_DRAWN),
+        get_render_stat_average(RS_ACTORS_CULLED), get_render_stat_average(RS_DRAW_CALLBACKS)
+    );
+}
+
+uint64_t get_render_stat(enum RenderStats stat) {
+    return last_render_stats[stat];
+}
+
+float get_render_stat_average(enum RenderStats stat) {
+    const size_t frames = SDL_min(render_frames, RENDER_STATS_WINDOW);
+    return (frames > 0) ? ((float)render_sums[stat] / (float)frames) : 0;
+}
+
+const char* get_render_stat_name(enum RenderStats stat) {
+    return render_stat_names[stat];
+}
+
+void set_render_stats_log(bool enabled) {
+    log_render_stats = enabled;
+}
+
+bool gpu_supports_s3tc() {
+    return s3tc_supported;
+}
+
 bool window_has_focus() {
     return SDL_GetWindowFlags(window) & SDL_WINDOW_INPUT_FOCUS;
 }
 
+bool window_is_minimized() {
+    return SDL_GetWindowFlags(window) & SDL_WINDOW_MINIMIZED;
+}
+
+void set_video_background(bool bg, bool min) {
+    background = bg;
+    minimized = min;
+}
+
 void lock_mouse_to_window(bool yes) {
     SDL_SetWindowRelativeMouseMode(window, yes);
 }
 
+// State cache
+// Forget everything we know, call this whenever GL objects get deleted since
+// their names can be reused.
+void invalidate_gl_state() {
+    active_unit = SDL_MAX_UINT32;
+    for (size_t i = 0; i < MAX_CACHED_TEXTURE_UNITS; i++) {
+        bound_targets[i] = 0;
+        bound_textures[i] = bound_samplers[i] = SDL_MAX_UINT32;
+    }
+    bound_vertex_array = bound_array_buffer = SDL_MAX_UINT32;
+    blend_func[0] = blend_func[1] = blend_func[2] = blend_func[3] = 0;
+    capabilities_known = 0;
+}
+
+void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit < MAX_CACHED_TEXTURE_UNITS && bound_targets[unit] == target && bound_textures[unit] == texture) {
+        avoided_gl_calls[SC_TEXTURE]++;
+        return;
+    }
+
+    if (active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+    }
+    glBindTexture(target, texture);
+    render_stats[RS_TEXTURE_BINDS]++;
+    if (unit < MAX_CACHED_TEXTURE_UNITS) {
+        bound_targets[unit] = target;
+        bound_textures[unit] = texture;
+    }
+}
+
+void bind_sampler(GLuint unit, enum SamplerTypes type) {
+    const GLuint sampler = samplers[type];
+    if (unit < MAX_CACHED_TEXTURE_UNITS) {
+        if (bound_samplers[unit] == sampler) {
+            avoided_gl_calls[SC_SAMPLER]++;
+            return;
+        }
+        bound_samplers[unit] = sampler;
+    }
+    glBindSampler(unit, sampler);
+}
+
+void bind_vertex_array(GLuint vao) {
+    if (bound_vertex_array == vao) {
+        avoided_gl_calls[SC_VERTEX_ARRAY]++;
+        return;
+    }
+    glBindVertexArray(vao);
+    bound_vertex_array = vao;
+}
+
+void bind_array_buffer(GLuint vbo) {
+    if (bound_array_buffer == vbo) {
+        avoided_gl_calls[SC_ARRAY_BUFFER]++;
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    bound_array_buffer = vbo;
+}
+
+void set_blend_func(GLenum src, GLenum dest, GLenum src_alpha, GLenum dest_alpha) {
+    if (blend_func[0] == src && blend_func[1] == dest && blend_func[2] == src_alpha && blend_func[3] == dest_alpha) {
+        avoided_gl_calls[SC_BLEND]++;
+        return;
+    }
+    glBlendFuncSeparate(src, dest, src_alpha, dest_alpha);
+    blend_func[0] = src;
+    blend_func[1] = dest;
+    blend_func[2] = src_alpha;
+    blend_func[3] = dest_alpha;
+}
+
+void set_capability(GLenum cap, bool enabled) {
+    uint8_t bit;
+    switch (cap) {
+        default:
+            if (enabled)
+                glEnable(cap);
+            else
+                glDisable(cap);
+            return;
+
+        case GL_BLEND:
+            bit = 1 << 0;
+            break;
+        case GL_DEPTH_TEST:
+            bit = 1 << 1;
+            break;
+        case GL_STENCIL_TEST:
+            bit = 1 << 2;
+            break;
+        case GL_CULL_FACE:
+            bit = 1 << 3;
+            break;
+    }
+
+    if ((capabilities_known & bit) && ((capabilities & bit) != 0) == enabled) {
+        avoided_gl_calls[SC_CAPABILITY]++;
+        return;
+    }
+
+    if (enabled) {
+        glEnable(cap);
+        capabilities |= bit;
+    } else {
+        glDisable(cap);
+        capabilities &= ~bit;
+    }
+    capabilities_known |= bit;
+}
+
+uint64_t get_avoided_gl_calls(enum StateCounters counter) {
+    return avoided_gl_calls[counter];
+}
+
+// GPU memory
+static void track_gpu_memory(
+    struct IntMap* map, GLuint name, enum GPUMemoryTypes type, const char* owner, size_t size
+) {
+    if (name == 0)
+        return;
+
+    // Reallocating the same object replaces its old size
+    struct GPUAllocation* allocation = from_int_map(map, name);
+    if (allocation == NULL) {
+        allocation = lame_alloc(sizeof(struct GPUAllocation));
+        to_int_map(map, name, allocation, false);
+    } else {
+        gpu_memory[allocation->type] -= allocation->size;
+        lame_free(&(allocation->owner));
+    }
+
+    allocation->type = type;
+    allocation->size = size;
+    allocation->owner = SDL_strdup(owner);
+    gpu_memory[type] += size;
+}
+
+static void untrack_gpu_memory(struct IntMap* map, GLuint name) {
+    struct GPUAllocation* allocation = pop_int_map(map, name, false);
+    if (allocation == NULL)
+        return;
+
+    gpu_memory[allocation->type] -= allocation->size;
+    lame_free(&(allocation->owner));
+    lame_free(&allocation);
+}
+
+static void clear_gpu_memory(struct IntMap* map) {
+    for (size_t i = 0; map->count > 0 && i < map->capacity; i++) {
+        struct IKeyValuePair* kvp = &(map->items[i]);
+        if (kvp->state != IKVP_OCCUPIED)
+            continue;
+        struct GPUAllocation* allocation = kvp->value;
+        lame_free(&(allocation->owner));
+        lame_free(&allocation);
+    }
+    destroy_int_map(map, false);
+}
+
+static void dump_gpu_allocations(struct IntMap* map, const char* kind) {
+    for (size_t i = 0; map->count > 0 && i < map->capacity; i++) {
+        const struct IKeyValuePair* kvp = &(map->items[i]);
+        if (kvp->state != IKVP_OCCUPIED)
+            continue;
+        const struct GPUAllocation* allocation = kvp->value;
+        INFO(
+            "%s %u (%s): %zu bytes, \"%s\"", kind, kvp->key, gpu_memory_names[allocation->type], allocation->size,
+            allocation->owner
+        );
+    }
+}
+
+void track_texture(GLuint texture, enum GPUMemoryTypes type, const char* owner, size_t size) {
+    track_gpu_memory(gpu_textures, texture, type, owner, size);
+}
+
+void track_buffer(GLuint buffer, enum GPUMemoryTypes type, const char* owner, size_t size) {
+    track_gpu_memory(gpu_buffers, buffer, type, owner, size);
+}
+
+void untrack_texture(GLuint texture) {
+    untrack_gpu_memory(gpu_textures, texture);
+}
+
+void untrack_buffer(GLuint buffer) {
+    untrack_gpu_memory(gpu_buffers, buffer);
+}
+
+size_t get_gpu_memory(enum GPUMemoryTypes type) {
+    return gpu_memory[type];
+}
+
+size_t get_gpu_memory_total() {
+    size_t total = 0;
+    for (size_t i = 0; i < GMT_SIZE; i++)
+        total += gpu_memory[i];
+    return total;
+}
+
+void log_gpu_memory() {
+    INFO("GPU memory: %.2f MB", (double)get_gpu_memory_total() / 1048576.0);
+    for (size_t i = 0; i < GMT_SIZE; i++)
+        INFO("- %s: %.2f MB", gpu_memory_names[i], (double)gpu_memory[i] / 1048576.0);
+}
+
+void dump_gpu_memory() {
+    dump_gpu_allocations(gpu_textures, "Texture");
+    dump_gpu_allocations(gpu_buffers, "Buffer");
+    log_gpu_memory();
+}
+
 // Shaders 'n' Uniforms
 void set_shader(struct Shader* shader) {
     struct Shader* target = (shader == NULL) ? default_shaders[render_stage] : shader;
     if (current_shader != target) {
-        submit_batch();
+        flush_batch(RS_SHADER_FLUSHES);
         current_shader = target;
         glUseProgram(target->program);
+    } else {
+        avoided_gl_calls[SC_PROGRAM]++;
     }
 }
 
-void set_uint_uniform(const char* name, const GLuint value) {
-    glUniform1ui((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value);
+// -1 makes glUniform* ignore uniforms the shader doesn't have
+static GLint get_uniform_location(Atom name) {
+    return (GLint)((intptr_t)from_hash_map_atom(current_shader->uniforms, name) - 1);
 }
 
-void set_uvec2_uniform(const char* name, const GLuint value[2]) {
-    glUniform2ui((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1]);
+void set_uint_uniform(Atom name, const GLuint value) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform1ui(get_uniform_location(name), value);
 }
 
-void set_uvec3_uniform(const char* name, const GLuint value[3]) {
-    glUniform3ui((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[3]);
+void set_uvec2_uniform(Atom name, const GLuint value[2]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform2ui(get_uniform_location(name), value[0], value[1]);
 }
 
-void set_uvec4_uniform(const char* name, const GLuint value[4]) {
-    glUniform4ui(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[2], value[3]
-    );
+void set_uvec3_uniform(Atom name, const GLuint value[3]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform3ui(get_uniform_location(name), value[0], value[1], value[2]);
 }
 
-void set_int_uniform(const char* name, const GLint value) {
-    glUniform1i((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value);
+void set_uvec4_uniform(Atom name, const GLuint value[4]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform4ui(get_uniform_location(name), value[0], value[1], value[2], value[3]);
 }
 
-void set_ivec2_uniform(const char* name, const GLint value[2]) {
-    glUniform2i((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1]);
+void set_int_uniform(Atom name, const GLint value) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform1i(get_uniform_location(name), value);
 }
 
-void set_ivec3_uniform(const char* name, const GLint value[3]) {
-    glUniform3i((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[2]);
+void set_ivec2_uniform(Atom name, const GLint value[2]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform2i(get_uniform_location(name), value[0], value[1]);
 }
 
-void set_ivec4_uniform(const char* name, const GLint value[4]) {
-    glUniform4i(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[2], value[3]
-    );
+void set_ivec3_uniform(Atom name, const GLint value[3]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform3i(get_uniform_location(name), value[0], value[1], value[2]);
 }
 
-void set_float_uniform(const char* name, const GLfloat value) {
-    glUniform1f((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value);
+void set_ivec4_uniform(Atom name, const GLint value[4]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform4i(get_uniform_location(name), value[0], value[1], value[2], value[3]);
 }
 
-void set_vec2_uniform(const char* name, const GLfloat value[2]) {
-    glUniform2f((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1]);
+void set_float_uniform(Atom name, const GLfloat value) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform1f(get_uniform_location(name), value);
 }
 
-void set_vec3_uniform(const char* name, const GLfloat value[3]) {
-    glUniform3f((GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[2]);
+void set_vec2_uniform(Atom name, const GLfloat value[2]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform2f(get_uniform_location(name), value[0], value[1]);
 }
 
-void set_vec4_uniform(const char* name, const GLfloat value[4]) {
-    glUniform4f(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), value[0], value[1], value[2], value[3]
-    );
+void set_vec3_uniform(Atom name, const GLfloat value[3]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform3f(get_uniform_location(name), value[0], value[1], value[2]);
 }
 
-void set_mat2_uniform(const char* name, mat2 matrix) {
-    glUniformMatrix2fv(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), 1, GL_FALSE, (const GLfloat*)matrix
-    );
+void set_vec4_uniform(Atom name, const GLfloat value[4]) {
+    render_stats[RS_UNIFORMS]++;
+    glUniform4f(get_uniform_location(name), value[0], value[1], value[2], value[3]);
 }
 
-void set_mat3_uniform(const char* name, mat3 matrix) {
-    glUniformMatrix3fv(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), 1, GL_FALSE, (const GLfloat*)matrix
-    );
+void set_mat2_uniform(Atom name, mat2 matrix) {
+    render_stats[RS_UNIFORMS]++;
+    glUniformMatrix2fv(get_uniform_location(name), 1, GL_FALSE, (const GLfloat*)matrix);
 }
 
-void set_mat4_uniform(const char* name, mat4 matrix) {
-    glUniformMatrix4fv(
-        (GLint)SDL_GetNumberProperty(current_shader->uniforms, name, -1), 1, GL_FALSE, (const GLfloat*)matrix
-    );
+void set_mat3_uniform(Atom name, mat3 matrix) {
+    render_stats[RS_UNIFORMS]++;
+    glUniformMatrix3fv(get_uniform_location(name), 1, GL_FALSE, (const GLfloat*)matrix);
+}
+
+void set_mat4_uniform(Atom name, mat4 matrix) {
+    render_stats[RS_UNIFORMS]++;
+    glUniformMatrix4fv(get_uniform_location(name), 1, GL_FALSE, (const GLfloat*)matrix);
 }
 
 // Render stages
@@ -511,6 +1276,14 @@ void set_render_stage(enum RenderTypes type) {
     }
 }
 
+// Count why a non-empty batch got submitted early
+static void flush_batch(enum RenderStats cause) {
+    if ((render_stage == RT_MAIN && main_batch.vertex_count > 0) ||
+        (render_stage == RT_WORLD && world_batch.vertex_count > 0))
+        render_stats[cause]++;
+    submit_batch();
+}
+
 void submit_batch() {
     switch (render_stage) {
         default:
@@ -530,35 +1303,34 @@ void submit_main_batch() {
         return;
 
     // Apply matrices
-    set_mat4_uniform("u_model_matrix", model_matrix);
-    set_mat4_uniform("u_view_matrix", view_matrix);
-    set_mat4_uniform("u_projection_matrix", projection_matrix);
-    set_mat4_uniform("u_mvp_matrix", mvp_matrix);
+    set_mat4_uniform(u_model_matrix, model_matrix);
+    set_mat4_uniform(u_view_matrix, view_matrix);
+    set_mat4_uniform(u_projection_matrix, projection_matrix);
+    set_mat4_uniform(u_mvp_matrix, mvp_matrix);
 
-    glBindVertexArray(main_batch.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, main_batch.vbo);
+    bind_vertex_array(main_batch.vao);
+    bind_array_buffer(main_batch.vbo);
     glBufferSubData(
         GL_ARRAY_BUFFER, 0, (GLsizeiptr)(sizeof(struct MainVertex) * main_batch.vertex_count), main_batch.vertices
     );
 
     // Apply stencil
-    set_vec4_uniform("u_stencil", main_batch.stencil);
+    set_vec4_uniform(u_stencil, main_batch.stencil);
 
     // Apply texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, main_batch.texture);
-    const GLint filter = main_batch.filter ? GL_LINEAR : GL_NEAREST;
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-    set_int_uniform("u_texture", 0);
-    set_float_uniform("u_alpha_test", main_batch.alpha_test);
+    bind_texture(0, GL_TEXTURE_2D, main_batch.texture);
+    bind_sampler(0, main_batch.filter ? ST_LINEAR : ST_NEAREST);
+    set_int_uniform(u_texture, 0);
+    set_float_uniform(u_alpha_test, main_batch.alpha_test);
 
     // Apply blend mode
-    glBlendFuncSeparate(
+    set_blend_func(
         main_batch.blend_src[0], main_batch.blend_dest[0], main_batch.blend_src[1], main_batch.blend_dest[1]
     );
 
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei)main_batch.vertex_count);
+    count_draw(main_batch.vertex_count);
+    render_stats[RS_FLUSHES]++;
     main_batch.vertex_count = 0;
 }
 
@@ -572,12 +1344,23 @@ void set_main_alpha(GLfloat a) {
     main_batch.color[3] = a;
 }
 
+// Textures still uploading are drawn blank. Everything drawn requests its
+// textures at the current streaming distance.
+static GLuint texture_or_blank(struct Texture* texture) {
+    if (texture == NULL)
+        return blank_texture;
+    request_texture(texture, stream_distance);
+    return (texture->texture == 0) ? blank_texture : texture->texture;
+}
+
 void set_main_texture(struct Texture* texture) {
-    set_main_texture_direct(texture == NULL ? blank_texture : texture->texture);
+    set_main_texture_direct(texture_or_blank(texture));
 }
 
 void set_main_texture_direct(GLuint texture) {
     if (main_batch.texture != texture) {
+        if (main_batch.vertex_count > 0)
+            render_stats[RS_TEXTURE_FLUSHES]++;
         submit_main_batch();
         main_batch.texture = texture;
     }
@@ -585,6 +1368,7 @@ void set_main_texture_direct(GLuint texture) {
 
 void main_vertex(GLfloat x, GLfloat y, GLfloat z, GLubyte r, GLubyte g, GLubyte b, GLubyte a, GLfloat u, GLfloat v) {
     if (main_batch.vertex_count >= main_batch.vertex_capacity) {
+        render_stats[RS_OVERFLOW_FLUSHES]++;
         submit_main_batch();
 
         const size_t new_size = main_batch.vertex_capacity * 2;
@@ -593,10 +1377,11 @@ void main_vertex(GLfloat x, GLfloat y, GLfloat z, GLubyte r, GLubyte g, GLubyte
         lame_realloc(&main_batch.vertices, new_size * sizeof(struct MainVertex));
         main_batch.vertex_capacity = new_size;
 
-        glBindBuffer(GL_ARRAY_BUFFER, main_batch.vbo);
+        bind_array_buffer(main_batch.vbo);
         glBufferData(
             GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct MainVertex) * main_batch.vertex_capacity), NULL, GL_DYNAMIC_DRAW
         );
+        track_buffer(main_batch.vbo, GMT_BATCH, "main", sizeof(struct MainVertex) * main_batch.vertex_capacity);
     }
 
     main_batch.vertices[main_batch.vertex_count++] = (struct MainVertex){x,
@@ -807,48 +1592,44 @@ void submit_world_batch() {
         return;
 
     // Apply matrices
-    set_mat4_uniform("u_model_matrix", model_matrix);
-    set_mat4_uniform("u_view_matrix", view_matrix);
-    set_mat4_uniform("u_projection_matrix", projection_matrix);
-    set_mat4_uniform("u_mvp_matrix", mvp_matrix);
+    set_mat4_uniform(u_model_matrix, model_matrix);
+    set_mat4_uniform(u_view_matrix, view_matrix);
+    set_mat4_uniform(u_projection_matrix, projection_matrix);
+    set_mat4_uniform(u_mvp_matrix, mvp_matrix);
 
-    glBindVertexArray(world_batch.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, world_batch.vbo);
+    bind_vertex_array(world_batch.vao);
+    bind_array_buffer(world_batch.vbo);
     glBufferSubData(
         GL_ARRAY_BUFFER, 0, (GLsizeiptr)(sizeof(struct WorldVertex) * world_batch.vertex_count), world_batch.vertices
     );
 
-    set_int_uniform("u_animated", 0);
-    set_vec4_uniform("u_color", world_batch.color);
-    set_vec4_uniform("u_stencil", world_batch.stencil);
+    set_int_uniform(u_animated, 0);
+    set_int_uniform(u_palette, PALETTE_TEXTURE_UNIT);
+    set_vec4_uniform(u_color, world_batch.color);
+    set_vec4_uniform(u_stencil, world_batch.stencil);
 
     // Apply texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, world_batch.texture);
-    if (world_batch.filter) {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    } else {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    }
-    set_int_uniform("u_texture", 0);
-    set_int_uniform("u_has_blend_texture", 0);
-    set_int_uniform("u_blend_texture", 1);
-    set_float_uniform("u_alpha_test", world_batch.alpha_test);
-    set_vec2_uniform("u_scroll", (GLfloat[2]){0});
-    set_vec3_uniform("u_material_wind", (GLfloat[3]){0});
-    set_float_uniform("u_bright", world_batch.bright);
-    set_int_uniform("u_half_lambert", 0);
-    set_float_uniform("u_cel", 0);
-    set_vec4_uniform("u_specular", (GLfloat[4]){0, 1, 0, 1});
+    bind_texture(0, GL_TEXTURE_2D, world_batch.texture);
+    bind_sampler(0, world_batch.filter ? ST_MIP_LINEAR : ST_MIP_NEAREST);
+    set_int_uniform(u_texture, 0);
+    set_int_uniform(u_has_blend_texture, 0);
+    set_int_uniform(u_blend_texture, 1);
+    set_float_uniform(u_alpha_test, world_batch.alpha_test);
+    set_vec2_uniform(u_scroll, (GLfloat[2]){0});
+    set_vec3_uniform(u_material_wind, (GLfloat[3]){0});
+    set_float_uniform(u_bright, world_batch.bright);
+    set_int_uniform(u_half_lambert, 0);
+    set_float_uniform(u_cel, 0);
+    set_vec4_uniform(u_specular, (GLfloat[4]){0, 1, 0, 1});
 
     // Apply blend mode
-    glBlendFuncSeparate(
+    set_blend_func(
         world_batch.blend_src[0], world_batch.blend_dest[0], world_batch.blend_src[1], world_batch.blend_dest[1]
     );
 
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei)world_batch.vertex_count);
+    count_draw(world_batch.vertex_count);
+    render_stats[RS_FLUSHES]++;
     world_batch.vertex_count = 0;
 }
 
@@ -863,11 +1644,13 @@ void set_world_alpha(GLfloat a) {
 }
 
 void set_world_texture(struct Texture* texture) {
-    set_world_texture_direct(texture == NULL ? blank_texture : texture->texture);
+    set_world_texture_direct(texture_or_blank(texture));
 }
 
 void set_world_texture_direct(GLuint texture) {
     if (world_batch.texture != texture) {
+        if (world_batch.vertex_count > 0)
+            render_stats[RS_TEXTURE_FLUSHES]++;
         submit_world_batch();
         world_batch.texture = texture;
     }
@@ -878,6 +1661,7 @@ void world_vertex(
     GLfloat u, GLfloat v
 ) {
     if (world_batch.vertex_count >= world_batch.vertex_capacity) {
+        render_stats[RS_OVERFLOW_FLUSHES]++;
         submit_world_batch();
 
         const size_t new_size = world_batch.vertex_capacity * 2;
@@ -886,11 +1670,12 @@ void world_vertex(
         lame_realloc(&world_batch.vertices, new_size * sizeof(struct WorldVertex));
         world_batch.vertex_capacity = new_size;
 
-        glBindBuffer(GL_ARRAY_BUFFER, world_batch.vbo);
+        bind_array_buffer(world_batch.vbo);
         glBufferData(
             GL_ARRAY_BUFFER, (GLsizeiptr)(sizeof(struct WorldVertex) * world_batch.vertex_capacity), NULL,
             GL_DYNAMIC_DRAW
         );
+        track_buffer(world_batch.vbo, GMT_BATCH, "world", sizeof(struct WorldVertex) * world_batch.vertex_capacity);
     }
 
     world_batch.vertices[world_batch.vertex_count++] =
@@ -926,6 +1711,64 @@ void set_active_camera(struct ActorCamera* camera) {
     active_camera = camera;
 }
 
+void set_depth_prepass(bool enabled) {
+    depth_prepass = enabled;
+}
+
+void set_gpu_interpolation(bool enabled) {
+    gpu_interpolation = enabled;
+
+    // Previous matrices and samples may be missing, rebuild them lazily
+    draw_count++;
+    palette_count = palette_uploaded = 0;
+}
+
+bool get_gpu_interpolation() {
+    return gpu_interpolation && get_framerate() > TICKRATE;
+}
+
+// With GPU interpolation, cameras are the only thing still blended on the CPU
+// since they build the view matrix.
+static void interpolate_camera(struct ActorCamera* camera, float ticks) {
+    glm_vec3_lerp(camera->draw_pos[0], camera->pos, ticks, camera->draw_pos[1]);
+    camera->draw_angle[1][0] = glm_lerp(camera->draw_angle[0][0], camera->angle[0], ticks);
+    camera->draw_angle[1][1] = glm_lerp(camera->draw_angle[0][1], camera->angle[1], ticks);
+    camera->draw_angle[1][2] = glm_lerp(camera->draw_angle[0][2], camera->angle[2], ticks);
+    camera->draw_fov[1] = glm_lerp(camera->draw_fov[0], camera->fov, ticks);
+    camera->draw_range[1] = glm_lerp(camera->draw_range[0], camera->range, ticks);
+}
+
+static void interpolate_lights(struct Room* room, float ticks) {
+    for (size_t i = 0; i < MAX_ROOM_LIGHTS; i++) {
+        struct ActorLight* light = room->light_occupied[i];
+        if (light == NULL)
+            continue;
+
+        struct RoomLight* rlight = light->light;
+        glm_vec3_lerp(light->actor->draw_pos[0], light->actor->pos, ticks, rlight->pos);
+        for (size_t j = 0; j < RL_ARGS; j++)
+            rlight->args[j] = glm_lerp(light->draw_args[0][j], light->draw_args[1][j], ticks);
+    }
+}
+
+static bool actor_in_view(struct ActorCamera* camera, struct Actor* actor, float* distance) {
+    if (!(actor->flags & AF_VISIBLE) || (camera == actor->camera && !(camera->flags & CF_THIRD_PERSON)))
+        return false;
+
+    // Attached models can be away from their actor, so use the cached matrix
+    vec3 center;
+    if (actor->model != NULL) {
+        update_model_instance_matrix(actor->model);
+        glm_vec3_copy(actor->model->draw_matrix[1][3], center);
+    } else {
+        glm_vec3_copy(actor->draw_pos[1], center);
+    }
+    center[2] -= actor->collision_size[1] * 0.5f;
+
+    *distance = glm_vec3_distance(camera->draw_pos[1], center);
+    return *distance > actor->cull_draw[0] && *distance < actor->cull_draw[1];
+}
+
 struct Surface* render_camera(
     struct ActorCamera* camera, uint16_t width, uint16_t height, bool draw_screen, struct Shader* world_shader,
     int listener
@@ -940,6 +1783,11 @@ struct Surface* render_camera(
     set_surface(camera->surface);
     clear_depth(1);
     clear_stencil(0);
+    render_stats[RS_SURFACES]++;
+
+    const bool interpolate = get_gpu_interpolation();
+    if (interpolate)
+        interpolate_camera(camera, get_ticks());
 
     // Build matrices
     static mat4 lookie;
@@ -977,7 +1825,7 @@ struct Surface* render_camera(
     set_render_stage(RT_WORLD);
 
     struct Room* room = camera->actor->room;
-    const float u_time = (float)draw_time / 1000.0f;
+    const float shader_time = (float)draw_time / 1000.0f;
 
     struct Actor* sky = room->sky;
     if (sky != NULL) {
@@ -985,15 +1833,17 @@ struct Surface* render_camera(
         glm_lookat(GLM_VEC3_ZERO, forward_vector, up_vector, sky_view);
         glm_mat4_mul(projection_matrix, sky_view, mvp_matrix);
         set_shader(sky_shader);
-        set_mat4_uniform("u_mvp_matrix", mvp_matrix);
-        set_float_uniform("u_time", u_time);
+        set_mat4_uniform(u_mvp_matrix, mvp_matrix);
+        set_float_uniform(u_time, shader_time);
 
         if (sky->model != NULL)
             submit_model_instance(sky->model);
         else
             clear_color(0, 0, 0, 1);
-        if (sky->type->draw != LUA_NOREF)
+        if (sky->type->draw != LUA_NOREF) {
             execute_ref_in(sky->type->draw, sky->userdata, sky->type->name);
+            render_stats[RS_DRAW_CALLBACKS]++;
+        }
 
         submit_world_batch();
     } else {
@@ -1004,53 +1854,100 @@ struct Surface* render_camera(
     glm_mat4_mul(view_matrix, model_matrix, mvp_matrix);
     glm_mat4_mul(projection_matrix, mvp_matrix, mvp_matrix);
 
-    glEnable(GL_CULL_FACE);
+    set_capability(GL_CULL_FACE, true);
 
-    glEnable(GL_DEPTH_TEST);
+    set_capability(GL_DEPTH_TEST, true);
     glDepthFunc(GL_LESS);
 
-    glEnable(GL_STENCIL_TEST);
+    set_capability(GL_STENCIL_TEST, true);
     glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
     glStencilFunc(GL_ALWAYS, 1, 0xFF);
     glStencilMask(0xFF);
 
     set_shader(world_shader);
-    set_float_uniform("u_time", u_time);
-    set_vec4_uniform("u_ambient", room->ambient);
+    set_float_uniform(u_time, shader_time);
+    set_vec4_uniform(u_ambient, room->ambient);
+    if (interpolate)
+        interpolate_lights(room, get_ticks());
+    render_stats[RS_UNIFORMS]++;
     glUniform1fv(
-        (GLint)(SDL_GetNumberProperty(current_shader->uniforms, "u_lights[0]", -1)),
-        MAX_ROOM_LIGHTS * (sizeof(struct RoomLight) / sizeof(GLfloat)), (const GLfloat*)room->lights
+        get_uniform_location(u_lights), MAX_ROOM_LIGHTS * (sizeof(struct RoomLight) / sizeof(GLfloat)),
+        (const GLfloat*)room->lights
     );
-    set_vec2_uniform("u_fog_distance", room->fog_distance);
-    set_vec4_uniform("u_fog_color", room->fog_color);
-    set_vec4_uniform("u_wind", room->wind);
+    set_vec2_uniform(u_fog_distance, room->fog_distance);
+    set_vec4_uniform(u_fog_color, room->fog_color);
+    set_vec4_uniform(u_wind, room->wind);
+
+    // Depth pre-pass: only models go through here, the world batch is
+    // drawn with regular depth testing since scripts draw into it.
+    const bool prepass = (depth_prepass || room->depth_prepass) &&
+                         get_uniform_location(u_depth_only) >= 0;
+    if (prepass) {
+        set_int_uniform(u_depth_only, 1);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        if (room->model != NULL)
+            draw_model_instance(room->model);
+
+        struct Actor* actor = room->actors;
+        while (actor != NULL) {
+            float distance;
+            if (actor->model != NULL && actor_in_view(camera, actor, &distance)) {
+                stream_distance = distance;
+                draw_model_instance(actor->model);
+            }
+            actor = actor->previous_neighbor;
+        }
+        stream_distance = 0;
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        set_int_uniform(u_depth_only, 0);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
     if (room->model != NULL)
         draw_model_instance(room->model);
 
     struct Actor* actor = room->actors;
     while (actor != NULL) {
-        if (actor->flags & AF_VISIBLE && (camera != actor->camera || (camera->flags & CF_THIRD_PERSON))) {
-            static vec3 center;
-            glm_vec3_copy(actor->draw_pos[1], center);
-            center[2] -= actor->collision_size[1] * 0.5f;
-
-            const float distance = glm_vec3_distance(camera->draw_pos[1], center);
-            if (distance > actor->cull_draw[0] && distance < actor->cull_draw[1]) {
-                if (actor->model != NULL)
-                    draw_model_instance(actor->model);
-                if (actor->type->draw != LUA_NOREF)
-                    execute_ref_in_child(actor->type->draw, actor->userdata, camera->userdata, actor->type->name);
+        float distance;
+        const bool visible = actor_in_view(camera, actor, &distance);
+        render_stats[visible ? RS_ACTORS_DRAWN : RS_ACTORS_CULLED]++;
+        if (visible) {
+            stream_distance = distance;
+            if (actor->model != NULL)
+                draw_model_instance(actor->model);
+            if (actor->type->draw != LUA_NOREF) {
+                if (prepass) {
+                    glDepthFunc(GL_LESS);
+                    glDepthMask(GL_TRUE);
+                }
+
+                execute_ref_in_child(actor->type->draw, actor->userdata, camera->userdata, actor->type->name);
+                render_stats[RS_DRAW_CALLBACKS]++;
+
+                if (prepass) {
+                    submit_world_batch();
+                    glDepthFunc(GL_EQUAL);
+                    glDepthMask(GL_FALSE);
+                }
             }
         }
         actor = actor->previous_neighbor;
     }
+    stream_distance = 0;
 
     submit_world_batch();
 
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
+    if (prepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    set_capability(GL_STENCIL_TEST, false);
+    set_capability(GL_DEPTH_TEST, false);
+    set_capability(GL_CULL_FACE, false);
 
     set_render_stage(RT_MAIN);
     set_shader(NULL);
@@ -1064,8 +1961,10 @@ struct Surface* render_camera(
 
     actor = room->actors;
     while (actor != NULL) {
-        if (actor->flags & AF_VISIBLE && actor->type->draw_screen != LUA_NOREF)
+        if (actor->flags & AF_VISIBLE && actor->type->draw_screen != LUA_NOREF) {
             execute_ref_in_child(actor->type->draw_screen, actor->userdata, camera->userdata, actor->type->name);
+            render_stats[RS_DRAW_CALLBACKS]++;
+        }
         actor = actor->previous_neighbor;
     }
 
@@ -1142,7 +2041,8 @@ struct Surface* create_surface(bool external, uint16_t width, uint16_t height, b
 }
 
 void validate_surface(struct Surface* surface) {
-    if (surface->fbo != 0)
+    // Without the context, set_surface() validates it later
+    if (surface->fbo != 0 || presenting)
         return;
     glGenFramebuffers(1, &surface->fbo);
 
@@ -1150,8 +2050,12 @@ void validate_surface(struct Surface* surface) {
         if (surface->texture[SURFACE_COLOR_TEXTURE] == 0)
             glGenTextures(1, &surface->texture[SURFACE_COLOR_TEXTURE]);
         glBindFramebuffer(GL_FRAMEBUFFER, surface->fbo);
-        glBindTexture(GL_TEXTURE_2D, surface->texture[SURFACE_COLOR_TEXTURE]);
+        bind_texture(0, GL_TEXTURE_2D, surface->texture[SURFACE_COLOR_TEXTURE]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, surface->size[0], surface->size[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        track_texture(
+            surface->texture[SURFACE_COLOR_TEXTURE], GMT_SURFACE, "color",
+            (size_t)surface->size[0] * surface->size[1] * 4
+        );
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
@@ -1159,19 +2063,25 @@ void validate_surface(struct Surface* surface) {
             GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface->texture[SURFACE_COLOR_TEXTURE], 0
         );
     } else if (surface->texture[SURFACE_COLOR_TEXTURE] != 0) {
+        untrack_texture(surface->texture[SURFACE_COLOR_TEXTURE]);
         glDeleteTextures(1, &surface->texture[SURFACE_COLOR_TEXTURE]);
         surface->texture[SURFACE_COLOR_TEXTURE] = 0;
+        invalidate_gl_state();
     }
 
     if (surface->enabled[SURFACE_DEPTH_TEXTURE]) {
         if (surface->texture[SURFACE_DEPTH_TEXTURE] == 0)
             glGenTextures(1, &surface->texture[SURFACE_DEPTH_TEXTURE]);
         glBindFramebuffer(GL_FRAMEBUFFER, surface->fbo);
-        glBindTexture(GL_TEXTURE_2D, surface->texture[SURFACE_DEPTH_TEXTURE]);
+        bind_texture(0, GL_TEXTURE_2D, surface->texture[SURFACE_DEPTH_TEXTURE]);
         glTexImage2D(
             GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, surface->size[0], surface->size[1], 0, GL_DEPTH_STENCIL,
             GL_UNSIGNED_INT_24_8, NULL
         );
+        track_texture(
+            surface->texture[SURFACE_DEPTH_TEXTURE], GMT_SURFACE, "depth",
+            (size_t)surface->size[0] * surface->size[1] * 4
+        );
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, 0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
@@ -1179,25 +2089,30 @@ void validate_surface(struct Surface* surface) {
             GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, surface->texture[SURFACE_DEPTH_TEXTURE], 0
         );
     } else if (surface->texture[SURFACE_DEPTH_TEXTURE] != 0) {
+        untrack_texture(surface->texture[SURFACE_DEPTH_TEXTURE]);
         glDeleteTextures(1, &surface->texture[SURFACE_DEPTH_TEXTURE]);
         surface->texture[SURFACE_DEPTH_TEXTURE] = 0;
+        invalidate_gl_state();
     }
 }
 
 void dispose_surface(struct Surface* surface) {
     if (current_surface == surface)
         pop_surface();
+    drop_pending_overrides(NULL, surface);
 
     if (surface->fbo != 0) {
-        glDeleteFramebuffers(1, &surface->fbo);
+        delete_gl_names(GLG_FRAMEBUFFER, 1, &surface->fbo);
         surface->fbo = 0;
     }
     if (surface->texture[SURFACE_COLOR_TEXTURE] != 0) {
-        glDeleteTextures(1, &surface->texture[SURFACE_COLOR_TEXTURE]);
+        untrack_texture(surface->texture[SURFACE_COLOR_TEXTURE]);
+        delete_gl_names(GLG_TEXTURE, 1, &surface->texture[SURFACE_COLOR_TEXTURE]);
         surface->texture[SURFACE_COLOR_TEXTURE] = 0;
     }
     if (surface->texture[SURFACE_DEPTH_TEXTURE] != 0) {
-        glDeleteTextures(1, &surface->texture[SURFACE_DEPTH_TEXTURE]);
+        untrack_texture(surface->texture[SURFACE_DEPTH_TEXTURE]);
+        delete_gl_names(GLG_TEXTURE, 1, &surface->texture[SURFACE_DEPTH_TEXTURE]);
         surface->texture[SURFACE_DEPTH_TEXTURE] = 0;
     }
 }
@@ -1281,7 +2196,7 @@ void clear_stencil(GLint stencil) {
 
 // Model Instance
 struct ModelInstance* create_model_instance(struct Model* model) {
-    struct ModelInstance* inst = lame_alloc_clean(sizeof(struct ModelInstance));
+    struct ModelInstance* inst = pool_alloc(model_instance_pool);
 
     inst->model = model;
     inst->userdata = create_pointer_ref("model_instance", inst);
@@ -1290,9 +2205,13 @@ struct ModelInstance* create_model_instance(struct Model* model) {
     glm_vec3_one(inst->draw_scale[1]);
     glm_vec4_one(inst->color);
 
-    inst->hidden = lame_alloc_clean(model->num_submodels * sizeof(bool));
-    inst->override_materials = (struct Material**)lame_alloc_clean(model->num_materials * sizeof(struct Material*));
-    inst->override_textures = lame_alloc_clean(model->num_materials * sizeof(GLuint));
+    // Per-instance overrides share one block, pointers first for alignment
+    const size_t materials_size = model->num_materials * sizeof(struct Material*);
+    const size_t textures_size = model->num_materials * sizeof(GLuint);
+    uint8_t* overrides = lame_alloc_clean(materials_size + textures_size + (model->num_submodels * sizeof(bool)));
+    inst->override_materials = (struct Material**)overrides;
+    inst->override_textures = (GLuint*)(overrides + materials_size);
+    inst->hidden = (bool*)(overrides + materials_size + textures_size);
 
     inst->frame_speed = 1;
 
@@ -1300,11 +2219,16 @@ struct ModelInstance* create_model_instance(struct Model* model) {
 }
 
 void destroy_model_instance(struct ModelInstance* inst) {
+    detach_model_instance(inst);
+    while (inst->children != NULL)
+        detach_model_instance(inst->children);
+
     unreference_pointer(&(inst->userdata));
+    drop_pending_overrides(inst, NULL);
 
-    FREE_POINTER(inst->hidden);
-    FREE_POINTER(inst->override_materials);
-    FREE_POINTER(inst->override_textures);
+    lame_free(&(inst->override_materials));
+    inst->override_textures = NULL;
+    inst->hidden = NULL;
 
     FREE_POINTER(inst->translations);
     FREE_POINTER(inst->rotations);
@@ -1313,7 +2237,55 @@ void destroy_model_instance(struct ModelInstance* inst) {
     FREE_POINTER(inst->draw_sample[0]);
     FREE_POINTER(inst->draw_sample[1]);
 
-    lame_free(&inst);
+    pool_free(model_instance_pool, &inst);
+}
+
+static void push_palette(struct ModelInstance* inst) {
+    if (inst->animation == NULL || inst->draw_sample[1] == NULL || inst->palette_frame == draw_count)
+        return;
+
+    // With GPU interpolation, the previous tick's sample follows the current
+    // one
+    const size_t num_bones = inst->model->num_bones;
+    const size_t count = get_gpu_interpolation() ? (num_bones * 2) : num_bones;
+    if (palette_count + count > palette_capacity) {
+        while (palette_count + count > palette_capacity)
+            palette_capacity *= 2;
+        lame_realloc(&palette, palette_capacity * sizeof(DualQuaternion));
+    }
+
+    lame_copy(&palette[palette_count], inst->draw_sample[1], num_bones * sizeof(DualQuaternion));
+    if (count > num_bones)
+        lame_copy(&palette[palette_count + num_bones], inst->draw_sample[0], num_bones * sizeof(DualQuaternion));
+    inst->palette_frame = draw_count;
+    inst->palette_offset = palette_count;
+    inst->palette_previous = (count > num_bones) ? (palette_count + num_bones) : palette_count;
+    palette_count += count;
+}
+
+static void upload_palette() {
+    if (palette_uploaded >= palette_count)
+        return;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, palette_buffer);
+    if (palette_gpu_capacity < palette_capacity) {
+        glBufferData(
+            GL_TEXTURE_BUFFER, (GLsizeiptr)(palette_capacity * sizeof(DualQuaternion)), NULL, GL_STREAM_DRAW
+        );
+        palette_gpu_capacity = palette_capacity;
+        palette_uploaded = 0;
+        track_buffer(palette_buffer, GMT_PALETTE, "skinning", palette_gpu_capacity * sizeof(DualQuaternion));
+    } else if (palette_uploaded <= 0) {
+        // Orphan last frame's palette
+        glBufferData(
+            GL_TEXTURE_BUFFER, (GLsizeiptr)(palette_gpu_capacity * sizeof(DualQuaternion)), NULL, GL_STREAM_DRAW
+        );
+    }
+    glBufferSubData(
+        GL_TEXTURE_BUFFER, (GLintptr)(palette_uploaded * sizeof(DualQuaternion)),
+        (GLsizeiptr)((palette_count - palette_uploaded) * sizeof(DualQuaternion)), &palette[palette_uploaded]
+    );
+    palette_uploaded = palette_count;
 }
 
 static void animate_model_instance(struct ModelInstance* inst, bool snap) {
@@ -1321,7 +2293,12 @@ static void animate_model_instance(struct ModelInstance* inst, bool snap) {
     if (inst->animation == NULL)
         return;
 
-    static DualQuaternion transframe[MAX_BONES] = {0};
+    // Scratch is dead on return, so don't let repeated calls between resets pile it up
+    const struct FrameMark scratch = lame_frame_mark();
+    const size_t scratch_size = SDL_max(inst->model->num_nodes, animation->num_nodes);
+    DualQuaternion* transframe = lame_frame_alloc(scratch_size * sizeof(DualQuaternion));
+    const struct Node** node_stack = lame_frame_alloc(scratch_size * sizeof(struct Node*));
+
     float frm = SDL_fabsf(inst->frame);
 
     if (animation->bone_frames != NULL) {
@@ -1360,7 +2337,6 @@ static void animate_model_instance(struct ModelInstance* inst, bool snap) {
             frame = transframe;
         }
 
-        static const struct Node* node_stack[MAX_BONES] = {0};
         const struct Model* model = inst->model;
         node_stack[0] = model->root_node;
         size_t next = 1;
@@ -1394,8 +2370,12 @@ static void animate_model_instance(struct ModelInstance* inst, bool snap) {
         }
     }
 
-    if (snap)
+    if (snap) {
         lame_copy(inst->draw_sample[0], inst->sample, inst->model->num_nodes * sizeof(DualQuaternion));
+        lame_copy(inst->draw_sample[1], inst->sample, inst->model->num_nodes * sizeof(DualQuaternion));
+    }
+
+    lame_frame_release(scratch);
 }
 
 void set_model_instance_animation(struct ModelInstance* inst, struct Animation* animation, float frame, bool loop) {
@@ -1438,6 +2418,7 @@ void set_model_instance_animation(struct ModelInstance* inst, struct Animation*
     inst->animation = animation;
     inst->frame = frame;
     inst->loop = loop;
+    inst->palette_frame = 0; // Snapping changes the draw sample
     if (animation != NULL)
         animate_model_instance(inst, true);
 }
@@ -1462,35 +2443,160 @@ void tick_model_instance(struct ModelInstance* inst) {
     animate_model_instance(inst, false);
 }
 
-void submit_model_instance(struct ModelInstance* inst) {
-    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE);
-
-    set_int_uniform("u_texture", 0);
-    set_vec4_uniform("u_color", inst->color);
-    set_vec4_uniform("u_stencil", (GLfloat[]){1, 1, 1, 0});
-
-    if (inst->model->lightmap != NULL) {
-        set_int_uniform("u_has_lightmap", 1);
-        set_int_uniform("u_lightmap", 2);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, inst->model->lightmap->texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+static void apply_model(const struct Model* model, const GLfloat color[4]) {
+    set_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA, GL_ONE);
+
+    set_int_uniform(u_texture, 0);
+    set_int_uniform(u_palette, PALETTE_TEXTURE_UNIT);
+    set_vec4_uniform(u_color, color);
+    set_vec4_uniform(u_stencil, (GLfloat[]){1, 1, 1, 0});
+
+    if (model->lightmap != NULL) {
+        set_int_uniform(u_has_lightmap, 1);
+        set_int_uniform(u_lightmap, 2);
+        bind_texture(2, GL_TEXTURE_2D, texture_or_blank(model->lightmap)); // Unlit until streamed in
+        bind_sampler(2, ST_LINEAR);
     } else {
-        set_int_uniform("u_has_lightmap", 0);
+        set_int_uniform(u_has_lightmap, 0);
+    }
+}
+
+static void apply_material(const struct Material* material, GLuint tex) {
+    if (tex == 0) {
+        struct Texture* texture =
+            material->textures[0] == NULL
+                ? NULL
+                : material->textures[0][(size_t)SDL_fmodf(
+                      (float)draw_time * material->texture_speed[0], (float)material->num_textures[0]
+                  )];
+        tex = texture_or_blank(texture);
+    }
+
+    const enum SamplerTypes sampler = material->filter ? ST_MIP_LINEAR : ST_MIP_NEAREST;
+    bind_texture(0, GL_TEXTURE_2D, tex);
+    bind_sampler(0, sampler);
+
+    if (material->textures[1] != NULL) {
+        set_int_uniform(u_has_blend_texture, 1);
+        set_int_uniform(u_blend_texture, 1);
+        struct Texture* blend_texture = material->textures[1][(size_t)SDL_fmodf(
+            (float)draw_time * material->texture_speed[1], (float)material->num_textures[1]
+        )];
+        bind_texture(1, GL_TEXTURE_2D, texture_or_blank(blend_texture));
+        bind_sampler(1, sampler);
+    } else {
+        set_int_uniform(u_has_blend_texture, 0);
+    }
+
+    set_float_uniform(u_alpha_test, material->alpha_test);
+    set_vec2_uniform(u_scroll, material->scroll);
+    set_vec3_uniform(u_material_wind, material->wind);
+    set_float_uniform(u_bright, material->bright);
+    set_int_uniform(u_half_lambert, material->half_lambert);
+    set_float_uniform(u_cel, material->cel);
+    set_vec4_uniform(u_specular, material->specular);
+}
+
+static float aabb_distance(vec3 box[2], vec3 point) {
+    vec3 delta;
+    for (size_t i = 0; i < 3; i++)
+        delta[i] = SDL_max(SDL_max(box[0][i] - point[i], point[i] - box[1][i]), 0);
+    return glm_vec3_norm(delta);
+}
+
+static void submit_model_batches(struct ModelInstance* inst, vec4* planes) {
+    const struct Model* model = inst->model;
+    if (model->num_submodels > batch_capacity) {
+        batch_capacity = model->num_submodels;
+        lame_realloc(&batch_firsts, batch_capacity * sizeof(GLint));
+        lame_realloc(&batch_counts, batch_capacity * sizeof(GLsizei));
+    }
+
+    for (size_t i = 0; i < model->num_batches; i++) {
+        const struct ModelBatch* batch = &(model->batches[i]);
+
+        struct Material* material = inst->override_materials[batch->material];
+        if (material == NULL) {
+            material = model->materials[batch->material];
+            if (material == NULL)
+                continue;
+        }
+
+        // Cull and hide chunks, merging neighbouring ones into a single range
+        size_t num_ranges = 0;
+        float nearest = INFINITY;
+        if (planes == NULL && inst->num_hidden <= 0) {
+            batch_firsts[0] = 0;
+            batch_counts[0] = (GLsizei)batch->num_vertices;
+            num_ranges = 1;
+        } else {
+            for (size_t j = 0; j < batch->num_chunks; j++) {
+                struct ModelChunk* chunk = &(batch->chunks[j]);
+                if (inst->hidden[chunk->submodel])
+                    continue;
+                if (planes != NULL) {
+                    if (!glm_aabb_frustum(chunk->bounds, planes))
+                        continue;
+                    nearest = SDL_min(nearest, aabb_distance(chunk->bounds, batch_eye));
+                }
+
+                if (num_ranges > 0 && batch_firsts[num_ranges - 1] + batch_counts[num_ranges - 1] == chunk->first) {
+                    batch_counts[num_ranges - 1] += chunk->count;
+                } else {
+                    batch_firsts[num_ranges] = chunk->first;
+                    batch_counts[num_ranges] = chunk->count;
+                    num_ranges++;
+                }
+            }
+        }
+        if (num_ranges <= 0)
+            continue;
+
+        // Stream textures by the nearest visible chunk instead of the instance
+        const float distance = stream_distance;
+        if (planes != NULL)
+            stream_distance = nearest;
+        apply_material(material, inst->override_textures[batch->material]);
+        stream_distance = distance;
+
+        bind_vertex_array(batch->vao);
+        if (num_ranges == 1)
+            glDrawArrays(GL_TRIANGLES, batch_firsts[0], batch_counts[0]);
+        else
+            glMultiDrawArrays(GL_TRIANGLES, batch_firsts, batch_counts, (GLsizei)num_ranges);
+
+        size_t vertices = 0;
+        for (size_t j = 0; j < num_ranges; j++)
+            vertices += (size_t)batch_counts[j];
+        count_draw(vertices);
     }
+}
+
+// Planes are optional, pass them to cull batched chunks.
+static void submit_model(struct ModelInstance* inst, vec4* planes) {
+    apply_model(inst->model, inst->color);
 
     if (inst->animation != NULL && inst->draw_sample[1] != NULL) {
-        set_int_uniform("u_animated", 1);
-        glUniform4fv(
-            (GLint)(SDL_GetNumberProperty(current_shader->uniforms, "u_sample[0]", -1)),
-            (GLsizei)(2 * inst->model->num_bones), (const GLfloat*)(inst->draw_sample[1])
-        );
+        // Instances that weren't gathered by video_prepare() get appended
+        // here
+        push_palette(inst);
+        upload_palette();
+
+        set_int_uniform(u_animated, 1);
+        set_int_uniform(u_palette_offset, (GLint)(inst->palette_offset * 2));
+        set_int_uniform(u_previous_palette_offset, (GLint)(inst->palette_previous * 2));
+        bind_texture(PALETTE_TEXTURE_UNIT, GL_TEXTURE_BUFFER, palette_texture);
     } else {
-        set_int_uniform("u_animated", 0);
+        set_int_uniform(u_animated, 0);
     }
 
+    // Batches leave out the chunks of hidden submodels
     struct Model* model = inst->model;
+    if (model->batches != NULL) {
+        submit_model_batches(inst, planes);
+        return;
+    }
+
     for (size_t i = 0; i < model->num_submodels; i++) {
         if (inst->hidden[i])
             continue;
@@ -1503,75 +2609,352 @@ void submit_model_instance(struct ModelInstance* inst) {
             if (material == NULL)
                 continue;
         }
+        apply_material(material, inst->override_textures[submodel->material]);
 
-        GLuint tex = inst->override_textures[submodel->material];
-        if (tex == 0) {
-            const struct Texture* texture =
-                material->textures[0] == NULL
-                    ? NULL
-                    : material->textures[0][(size_t)SDL_fmodf(
-                          (float)draw_time * material->texture_speed[0], (float)material->num_textures[0]
-                      )];
-            tex = (texture == NULL) ? blank_texture : texture->texture;
-        }
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        const GLint downscale = material->filter ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_LINEAR;
-        const GLint upscale = material->filter ? GL_LINEAR : GL_NEAREST;
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, downscale);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, upscale);
-
-        if (material->textures[1] != NULL) {
-            set_int_uniform("u_has_blend_texture", 1);
-            set_int_uniform("u_blend_texture", 1);
-            const struct Texture* blend_texture = material->textures[1][(size_t)SDL_fmodf(
-                (float)draw_time * material->texture_speed[1], (float)material->num_textures[1]
-            )];
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, blend_texture == NULL ? blank_texture : blend_texture->texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, downscale);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, upscale);
-        } else {
-            set_int_uniform("u_has_blend_texture", 0);
-        }
-
-        set_float_uniform("u_alpha_test", material->alpha_test);
-        set_vec2_uniform("u_scroll", material->scroll);
-        set_vec3_uniform("u_material_wind", material->wind);
-        set_float_uniform("u_bright", material->bright);
-        set_int_uniform("u_half_lambert", material->half_lambert);
-        set_float_uniform("u_cel", material->cel);
-        set_vec4_uniform("u_specular", material->specular);
-
-        glBindVertexArray(submodel->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, submodel->vbo);
+        bind_vertex_array(submodel->vao);
+        bind_array_buffer(submodel->vbo);
         glBufferSubData(
             GL_ARRAY_BUFFER, 0, (GLsizeiptr)(sizeof(struct WorldVertex) * submodel->num_vertices), submodel->vertices
         );
         glDrawArrays(GL_TRIANGLES, 0, (GLsizei)submodel->num_vertices);
+        count_draw(submodel->num_vertices);
+    }
+}
+
+void submit_model_instance(struct ModelInstance* inst) {
+    submit_model(inst, NULL);
+}
+
+static void build_matrix(mat4 dest, vec3 pos, vec3 angle, vec3 scale) {
+    glm_mat4_identity(dest);
+    glm_scale(dest, scale);
+    glm_spin(dest, glm_rad(angle[0]), GLM_ZUP);
+    glm_spin(dest, glm_rad(angle[1]), GLM_YUP);
+    glm_spin(dest, glm_rad(angle[2]), GLM_XUP);
+    glm_translated(dest, pos);
+}
+
+bool attach_model_instance(struct ModelInstance* inst, struct ModelInstance* parent, size_t node) {
+    // Don't allow cycles
+    struct ModelInstance* it = parent;
+    while (it != NULL) {
+        if (it == inst)
+            return false;
+        it = it->parent;
+    }
+
+    detach_model_instance(inst);
+    inst->parent = parent;
+    inst->parent_node = node;
+    inst->next_sibling = parent->children;
+    parent->children = inst;
+    inst->matrix_frame = 0;
+    return true;
+}
+
+void detach_model_instance(struct ModelInstance* inst) {
+    struct ModelInstance* parent = inst->parent;
+    if (parent == NULL)
+        return;
+
+    struct ModelInstance** it = &(parent->children);
+    while (*it != NULL) {
+        if (*it == inst) {
+            *it = inst->next_sibling;
+            break;
+        }
+        it = &((*it)->next_sibling);
+    }
+    inst->parent = inst->next_sibling = NULL;
+    inst->matrix_frame = 0;
+}
+
+void override_model_instance_texture(struct ModelInstance* inst, size_t material, struct Texture* texture) {
+    override_texture(inst, material, texture, NULL);
+}
+
+void override_model_instance_surface(struct ModelInstance* inst, size_t material, struct Surface* surface) {
+    override_texture(inst, material, NULL, surface);
+}
+
+void update_model_instance_matrix(struct ModelInstance* inst) {
+    if (inst->matrix_frame == draw_count)
+        return;
+    inst->matrix_frame = draw_count;
+
+    // The previous tick's matrix is only needed for GPU interpolation
+    const bool interpolate = get_gpu_interpolation();
+    build_matrix(inst->draw_matrix[1], inst->draw_pos[1], inst->draw_angle[1], inst->draw_scale[1]);
+    if (interpolate)
+        build_matrix(inst->draw_matrix[0], inst->draw_pos[0], inst->draw_angle[0], inst->draw_scale[0]);
+
+    // Attachments are relative to their parent's node, or its origin if the
+    // parent isn't animated
+    struct ModelInstance* parent = inst->parent;
+    if (parent != NULL) {
+        update_model_instance_matrix(parent);
+
+        mat4 node_matrix = GLM_MAT4_IDENTITY_INIT;
+        if (parent->transforms != NULL && inst->parent_node < parent->model->num_nodes)
+            dq_to_mat4(parent->transforms[inst->parent_node], node_matrix);
+
+        mat4 offset;
+        glm_mat4_mul(parent->draw_matrix[1], node_matrix, offset);
+        glm_mat4_mul(offset, inst->draw_matrix[1], inst->draw_matrix[1]);
+        if (interpolate) {
+            glm_mat4_mul(parent->draw_matrix[0], node_matrix, offset);
+            glm_mat4_mul(offset, inst->draw_matrix[0], inst->draw_matrix[0]);
+        }
     }
 }
 
 void draw_model_instance(struct ModelInstance* inst) {
-    glm_mat4_identity(model_matrix);
-    glm_scale(model_matrix, inst->draw_scale[1]);
-    glm_spin(model_matrix, glm_rad(inst->draw_angle[1][0]), GLM_ZUP);
-    glm_spin(model_matrix, glm_rad(inst->draw_angle[1][1]), GLM_YUP);
-    glm_spin(model_matrix, glm_rad(inst->draw_angle[1][2]), GLM_XUP);
-    glm_translated(model_matrix, inst->draw_pos[1]);
+    update_model_instance_matrix(inst);
+
+    // Leave the global matrices alone, the world batch still uses them
+    mat4 inst_mvp;
+    glm_mat4_mul(view_matrix, inst->draw_matrix[1], inst_mvp);
+    glm_mat4_mul(projection_matrix, inst_mvp, inst_mvp);
+
+    set_mat4_uniform(u_model_matrix, inst->draw_matrix[1]);
+    set_mat4_uniform(u_view_matrix, view_matrix);
+    set_mat4_uniform(u_projection_matrix, projection_matrix);
+    set_mat4_uniform(u_mvp_matrix, inst_mvp);
+
+    // Send the previous tick's transform and let the shader blend it
+    const bool interpolate = get_gpu_interpolation();
+    if (interpolate) {
+        set_mat4_uniform(u_previous_model_matrix, inst->draw_matrix[0]);
+        set_float_uniform(u_previous_weight, previous_weight);
+    }
 
-    glm_mat4_mul(view_matrix, model_matrix, mvp_matrix);
-    glm_mat4_mul(projection_matrix, mvp_matrix, mvp_matrix);
+    if (inst->model->batches != NULL) {
+        vec4 planes[6];
+        glm_frustum_planes(inst_mvp, planes);
+
+        // Camera position in model space, for chunk distances
+        mat4 inverse;
+        glm_mat4_mul(view_matrix, inst->draw_matrix[1], inverse);
+        glm_mat4_inv(inverse, inverse);
+        glm_vec3_copy(inverse[3], batch_eye);
+
+        submit_model(inst, planes);
+    } else {
+        submit_model(inst, NULL);
+    }
+
+    if (interpolate)
+        set_float_uniform(u_previous_weight, 0);
+}
+
+// Crowds
+struct Crowd* create_crowd(bool external, struct Model* model, struct Animation* animation) {
+    struct Crowd* crowd =
+        external ? userdata_alloc_clean("crowd", sizeof(struct Crowd)) : lame_alloc_clean(sizeof(struct Crowd));
+    crowd->model = model;
+    crowd->animation = animation;
+    crowd->num_frames = animation->num_frames;
+
+    // Bake every frame's bone samples, they're uploaded as a texture with one
+    // row per frame on the first draw
+    const size_t num_bones = model->num_bones;
+    crowd->baked = lame_alloc(crowd->num_frames * num_bones * sizeof(DualQuaternion));
+    struct ModelInstance* inst = create_model_instance(model);
+    for (size_t i = 0; i < crowd->num_frames; i++) {
+        set_model_instance_animation(inst, animation, (float)i, true);
+        lame_copy(&(crowd->baked[i * num_bones]), inst->sample, num_bones * sizeof(DualQuaternion));
+    }
+    destroy_model_instance(inst);
 
-    set_mat4_uniform("u_model_matrix", model_matrix);
-    set_mat4_uniform("u_view_matrix", view_matrix);
-    set_mat4_uniform("u_projection_matrix", projection_matrix);
-    set_mat4_uniform("u_mvp_matrix", mvp_matrix);
+    // Instance buffer, uploaded on the first draw as well
+    crowd->capacity = CROWD_CAPACITY;
+    crowd->instances = lame_alloc(crowd->capacity * sizeof(struct CrowdInstance));
 
-    submit_model_instance(inst);
+    return crowd;
+}
+
+void dispose_crowd(struct Crowd* crowd) {
+    if (crowd->vaos != NULL) {
+        delete_gl_names(GLG_VERTEX_ARRAY, (GLsizei)crowd->num_vaos, crowd->vaos);
+        lame_free(&(crowd->vaos));
+    }
+    if (crowd->vbo != 0) {
+        untrack_buffer(crowd->vbo);
+        delete_gl_names(GLG_BUFFER, 1, &crowd->vbo);
+        crowd->vbo = 0;
+    }
+    if (crowd->frames != 0) {
+        untrack_texture(crowd->frames);
+        delete_gl_names(GLG_TEXTURE, 1, &crowd->frames);
+        crowd->frames = 0;
+    }
+    FREE_POINTER(crowd->baked);
+    FREE_POINTER(crowd->instances);
+    crowd->num_instances = crowd->capacity = crowd->gpu_capacity = 0;
+}
+
+void destroy_crowd(struct Crowd* crowd) {
+    dispose_crowd(crowd);
+    lame_free(&crowd);
+}
+
+void add_crowd_instance(struct Crowd* crowd, vec3 pos, vec3 angle, vec3 scale, float frame, float speed) {
+    if (crowd->instances == NULL)
+        return;
+    if (crowd->num_instances >= crowd->capacity) {
+        const size_t new_size = crowd->capacity * 2;
+        if (new_size < crowd->capacity)
+            FATAL("Capacity overflow in crowd");
+        lame_realloc(&crowd->instances, new_size * sizeof(struct CrowdInstance));
+        crowd->capacity = new_size;
+    }
+
+    struct CrowdInstance* instance = &crowd->instances[crowd->num_instances++];
+    mat4 matrix;
+    build_matrix(matrix, pos, angle, scale);
+    lame_copy(instance->matrix, matrix, sizeof(instance->matrix));
+    instance->frame[0] = frame;
+    instance->frame[1] = speed;
+    crowd->dirty = true;
+}
+
+void clear_crowd(struct Crowd* crowd) {
+    crowd->num_instances = 0;
+}
+
+// Crowds can be created during the tick, so their GL objects are made on the
+// first draw
+static void validate_crowd(struct Crowd* crowd) {
+    if (crowd->baked == NULL)
+        return;
+
+    const struct Model* model = crowd->model;
+    const size_t num_bones = model->num_bones;
+
+    glGenTextures(1, &crowd->frames);
+    bind_texture(CROWD_TEXTURE_UNIT, GL_TEXTURE_2D, crowd->frames);
+    glTexImage2D(
+        GL_TEXTURE_2D, 0, GL_RGBA32F, (GLsizei)(2 * num_bones), (GLsizei)crowd->num_frames, 0, GL_RGBA, GL_FLOAT,
+        crowd->baked
+    );
+    track_texture(crowd->frames, GMT_CROWD, model->name, crowd->num_frames * num_bones * sizeof(DualQuaternion));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    lame_free(&(crowd->baked));
+
+    // Instance buffer
+    glGenBuffers(1, &crowd->vbo);
+    bind_array_buffer(crowd->vbo);
+    glBufferData(
+        GL_ARRAY_BUFFER, (GLsizeiptr)(crowd->capacity * sizeof(struct CrowdInstance)), NULL, GL_DYNAMIC_DRAW
+    );
+    crowd->gpu_capacity = crowd->capacity;
+    track_buffer(crowd->vbo, GMT_CROWD, model->name, crowd->gpu_capacity * sizeof(struct CrowdInstance));
+
+    // Each submodel gets a VAO that pulls per-instance data from the crowd.
+    // Crowds are skinned, so their models are never batched.
+    crowd->num_vaos = model->num_submodels;
+    crowd->vaos = lame_alloc(crowd->num_vaos * sizeof(GLuint));
+    glGenVertexArrays((GLsizei)crowd->num_vaos, crowd->vaos);
+    for (size_t i = 0; i < crowd->num_vaos; i++) {
+        bind_vertex_array(crowd->vaos[i]);
+
+        bind_array_buffer(model->submodels[i].vbo);
+        glEnableVertexAttribArray(VATT_POSITION);
+        glVertexAttribPointer(
+            VATT_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
+            (void*)offsetof(struct WorldVertex, position)
+        );
+        glEnableVertexAttribArray(VATT_NORMAL);
+        glVertexAttribPointer(
+            VATT_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, normal)
+        );
+        glEnableVertexAttribArray(VATT_COLOR);
+        glVertexAttribPointer(
+            VATT_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct WorldVertex),
+            (void*)offsetof(struct WorldVertex, color)
+        );
+        glEnableVertexAttribArray(VATT_UV);
+        glVertexAttribPointer(
+            VATT_UV, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex), (void*)offsetof(struct WorldVertex, uv)
+        );
+        glEnableVertexAttribArray(VATT_BONE_INDEX);
+        glVertexAttribPointer(
+            VATT_BONE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
+            (void*)offsetof(struct WorldVertex, bone_index)
+        );
+        glEnableVertexAttribArray(VATT_BONE_WEIGHT);
+        glVertexAttribPointer(
+            VATT_BONE_WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(struct WorldVertex),
+            (void*)offsetof(struct WorldVertex, bone_weight)
+        );
+
+        bind_array_buffer(crowd->vbo);
+        for (GLuint j = 0; j < 4; j++) {
+            glEnableVertexAttribArray(VATT_INSTANCE_MATRIX + j);
+            glVertexAttribPointer(
+                VATT_INSTANCE_MATRIX + j, 4, GL_FLOAT, GL_FALSE, sizeof(struct CrowdInstance),
+                (void*)(offsetof(struct CrowdInstance, matrix) + (j * 4 * sizeof(GLfloat)))
+            );
+            glVertexAttribDivisor(VATT_INSTANCE_MATRIX + j, 1);
+        }
+        glEnableVertexAttribArray(VATT_INSTANCE_FRAME);
+        glVertexAttribPointer(
+            VATT_INSTANCE_FRAME, 2, GL_FLOAT, GL_FALSE, sizeof(struct CrowdInstance),
+            (void*)offsetof(struct CrowdInstance, frame)
+        );
+        glVertexAttribDivisor(VATT_INSTANCE_FRAME, 1);
+    }
+
+}
+
+void draw_crowd(struct Crowd* crowd) {
+    if (render_stage != RT_WORLD || crowd->instances == NULL || crowd->num_instances <= 0)
+        return;
+    submit_world_batch();
+    validate_crowd(crowd);
+
+    bind_array_buffer(crowd->vbo);
+    if (crowd->gpu_capacity < crowd->capacity) {
+        glBufferData(
+            GL_ARRAY_BUFFER, (GLsizeiptr)(crowd->capacity * sizeof(struct CrowdInstance)), NULL, GL_DYNAMIC_DRAW
+        );
+        crowd->gpu_capacity = crowd->capacity;
+        crowd->dirty = true;
+        track_buffer(crowd->vbo, GMT_CROWD, crowd->model->name, crowd->gpu_capacity * sizeof(struct CrowdInstance));
+    }
+    if (crowd->dirty) {
+        glBufferSubData(
+            GL_ARRAY_BUFFER, 0, (GLsizeiptr)(crowd->num_instances * sizeof(struct CrowdInstance)), crowd->instances
+        );
+        crowd->dirty = false;
+    }
 
     glm_mat4_identity(model_matrix);
-    glm_mat4_mul(view_matrix, model_matrix, mvp_matrix);
-    glm_mat4_mul(projection_matrix, mvp_matrix, mvp_matrix);
+    set_mat4_uniform(u_model_matrix, model_matrix);
+    set_mat4_uniform(u_view_matrix, view_matrix);
+    set_mat4_uniform(u_projection_matrix, projection_matrix);
+
+    apply_model(crowd->model, GLM_VEC4_ONE);
+    set_int_uniform(u_animated, 0);
+    set_int_uniform(u_crowd, 1);
+    set_int_uniform(u_crowd_frames, CROWD_TEXTURE_UNIT);
+    set_float_uniform(u_crowd_time, get_world_ticks() * crowd->animation->frame_speed);
+    bind_texture(CROWD_TEXTURE_UNIT, GL_TEXTURE_2D, crowd->frames);
+
+    const struct Model* model = crowd->model;
+    for (size_t i = 0; i < crowd->num_vaos; i++) {
+        const struct Submodel* submodel = &(model->submodels[i]);
+        const struct Material* material = model->materials[submodel->material];
+        if (material == NULL)
+            continue;
+        apply_material(material, 0);
+
+        bind_vertex_array(crowd->vaos[i]);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, (GLsizei)submodel->num_vertices, (GLsizei)crowd->num_instances);
+        count_draw(submodel->num_vertices * crowd->num_instances);
+    }
+
+    set_int_uniform(u_crowd, 0);
 }
@@ -22,7 +22,19 @@
 #define SURFACE_COLOR_TEXTURE 0
 #define SURFACE_DEPTH_TEXTURE 1
 
-#define MAX_BONES 128
+#define PALETTE_CAPACITY 256 // Initial amount of dual quaternions
+#define PALETTE_TEXTURE_UNIT 3
+
+#define MODEL_INSTANCE_POOL_SIZE 256
+
+#define CROWD_CAPACITY 16
+#define CROWD_TEXTURE_UNIT 4
+
+#define MAX_FRAME_LATENCY 4
+
+#define MAX_CACHED_TEXTURE_UNITS 8
+
+#define RENDER_STATS_WINDOW 60 // Frames that averages are taken over
 
 enum FullscreenModes {
     FSM_WINDOWED,
@@ -36,6 +48,60 @@ enum RenderTypes {
     RT_SIZE,
 };
 
+enum GLGarbageTypes {
+    GLG_TEXTURE,
+    GLG_BUFFER,
+    GLG_VERTEX_ARRAY,
+    GLG_FRAMEBUFFER,
+    GLG_SIZE,
+};
+
+enum SamplerTypes {
+    ST_NEAREST,
+    ST_LINEAR,
+    ST_MIP_NEAREST,
+    ST_MIP_LINEAR,
+    ST_SIZE,
+};
+
+enum StateCounters {
+    SC_TEXTURE,
+    SC_SAMPLER,
+    SC_VERTEX_ARRAY,
+    SC_ARRAY_BUFFER,
+    SC_PROGRAM,
+    SC_BLEND,
+    SC_CAPABILITY,
+    SC_SIZE,
+};
+
+enum RenderStats {
+    RS_DRAW_CALLS,
+    RS_VERTICES,
+    RS_FLUSHES,
+    RS_TEXTURE_FLUSHES,
+    RS_SHADER_FLUSHES,
+    RS_OVERFLOW_FLUSHES,
+    RS_UNIFORMS,
+    RS_TEXTURE_BINDS,
+    RS_SURFACES,
+    RS_ACTORS_DRAWN,
+    RS_ACTORS_CULLED,
+    RS_DRAW_CALLBACKS,
+    RS_SIZE,
+};
+
+enum GPUMemoryTypes {
+    GMT_TEXTURE,
+    GMT_MODEL,
+    GMT_SURFACE,
+    GMT_BATCH,
+    GMT_PALETTE,
+    GMT_CROWD,
+    GMT_STAGING,
+    GMT_SIZE,
+};
+
 enum VertexAttributes {
     VATT_POSITION,
     VATT_NORMAL,
@@ -43,6 +109,8 @@ enum VertexAttributes {
     VATT_UV,
     VATT_BONE_INDEX,
     VATT_BONE_WEIGHT,
+    VATT_INSTANCE_MATRIX,
+    VATT_INSTANCE_FRAME = VATT_INSTANCE_MATRIX + 4, // Matrices take up 4 slots
     VATT_SIZE,
 };
 
@@ -111,6 +179,7 @@ struct ModelInstance {
     vec4 color;
 
     bool* hidden;
+    size_t num_hidden;
     struct Material** override_materials;
     GLuint* override_textures;
 
@@ -122,10 +191,42 @@ struct ModelInstance {
     DualQuaternion *transforms, *sample;
 
     DualQuaternion* draw_sample[2];
+
+    uint64_t palette_frame;
+    size_t palette_offset, palette_previous;
+
+    // World matrices, built once per draw state
+    mat4 draw_matrix[2];
+    uint64_t matrix_frame;
+
+    struct ModelInstance *parent, *children, *next_sibling; // Attachments
+    size_t parent_node;
+};
+
+struct CrowdInstance {
+    GLfloat matrix[16];
+    GLfloat frame[2]; // Starting frame and speed
+};
+
+struct Crowd {
+    struct Model* model;
+    struct Animation* animation;
+
+    GLuint frames; // Baked bone samples, one row per frame
+    DualQuaternion* baked; // Waiting for upload in draw_crowd()
+    size_t num_frames;
+
+    GLuint vbo, *vaos;
+    size_t num_vaos;
+    struct CrowdInstance* instances;
+    size_t num_instances, capacity, gpu_capacity;
+    bool dirty;
 };
 
 void video_init(bool);
 void video_update();
+void video_prepare();
+void video_sync();
 void video_teardown();
 
 // Display
@@ -134,32 +235,65 @@ void set_display(int, int, enum FullscreenModes, bool);
 void update_display();
 uint16_t get_framerate();
 void set_framerate(uint16_t);
+void set_background_framerate(uint16_t);
+uint64_t get_next_frame_time();
+void set_frame_latency(uint8_t);
+void update_present_thread();
+void set_present_thread(bool);
 
 uint64_t get_draw_time();
+uint64_t get_render_stat(enum RenderStats);
+float get_render_stat_average(enum RenderStats);
+const char* get_render_stat_name(enum RenderStats);
+void set_render_stats_log(bool);
+bool gpu_supports_s3tc();
 bool window_has_focus();
+bool window_is_minimized();
+void set_video_background(bool, bool);
 void lock_mouse_to_window(bool);
 
+// State cache
+void invalidate_gl_state();
+void bind_texture(GLuint, GLenum, GLuint);
+void bind_sampler(GLuint, enum SamplerTypes);
+void bind_vertex_array(GLuint);
+void bind_array_buffer(GLuint);
+void set_blend_func(GLenum, GLenum, GLenum, GLenum);
+void set_capability(GLenum, bool);
+uint64_t get_avoided_gl_calls(enum StateCounters);
+
+// GPU memory
+void track_texture(GLuint, enum GPUMemoryTypes, const char*, size_t);
+void track_buffer(GLuint, enum GPUMemoryTypes, const char*, size_t);
+void untrack_texture(GLuint);
+void untrack_buffer(GLuint);
+size_t get_gpu_memory(enum GPUMemoryTypes);
+size_t get_gpu_memory_total();
+void log_gpu_memory();
+void dump_gpu_memory();
+
 // Shaders 'n' uniforms
+// Uniform names are atoms, see intern()
 void set_shader(struct Shader*);
 
-void set_uint_uniform(const char*, const GLuint);
-void set_uvec2_uniform(const char*, const GLuint[2]);
-void set_uvec3_uniform(const char*, const GLuint[3]);
-void set_uvec4_uniform(const char*, const GLuint[4]);
+void set_uint_uniform(Atom, const GLuint);
+void set_uvec2_uniform(Atom, const GLuint[2]);
+void set_uvec3_uniform(Atom, const GLuint[3]);
+void set_uvec4_uniform(Atom, const GLuint[4]);
 
-void set_int_uniform(const char*, const GLint);
-void set_ivec2_uniform(const char*, const GLint[2]);
-void set_ivec3_uniform(const char*, const GLint[3]);
-void set_ivec4_uniform(const char*, const GLint[4]);
+void set_int_uniform(Atom, const GLint);
+void set_ivec2_uniform(Atom, const GLint[2]);
+void set_ivec3_uniform(Atom, const GLint[3]);
+void set_ivec4_uniform(Atom, const GLint[4]);
 
-void set_float_uniform(const char*, const GLfloat);
-void set_vec2_uniform(const char*, const GLfloat[2]);
-void set_vec3_uniform(const char*, const GLfloat[3]);
-void set_vec4_uniform(const char*, const GLfloat[4]);
+void set_float_uniform(Atom, const GLfloat);
+void set_vec2_uniform(Atom, const GLfloat[2]);
+void set_vec3_uniform(Atom, const GLfloat[3]);
+void set_vec4_uniform(Atom, const GLfloat[4]);
 
-void set_mat2_uniform(const char*, mat2);
-void set_mat3_uniform(const char*, mat3);
-void set_mat4_uniform(const char*, mat4);
+void set_mat2_uniform(Atom, mat2);
+void set_mat3_uniform(Atom, mat3);
+void set_mat4_uniform(Atom, mat4);
 
 // Render stages
 void set_render_stage(enum RenderTypes);
@@ -204,6 +338,9 @@ void world_vertex(
 struct ActorCamera* get_active_camera();
 void set_active_camera(struct ActorCamera*);
 struct Surface* render_camera(struct ActorCamera*, uint16_t, uint16_t, bool, struct Shader*, int);
+void set_depth_prepass(bool);
+void set_gpu_interpolation(bool);
+bool get_gpu_interpolation();
 
 // Fonts
 GLfloat string_width(const char*, struct Font*, GLfloat);
@@ -228,6 +365,19 @@ void destroy_model_instance(struct ModelInstance*);
 void set_model_instance_animation(struct ModelInstance*, struct Animation*, float, bool);
 void translate_model_instance_node(struct ModelInstance*, size_t, versor);
 void rotate_model_instance_node(struct ModelInstance*, size_t, versor);
+bool attach_model_instance(struct ModelInstance*, struct ModelInstance*, size_t);
+void detach_model_instance(struct ModelInstance*);
+void override_model_instance_texture(struct ModelInstance*, size_t, struct Texture*);
+void override_model_instance_surface(struct ModelInstance*, size_t, struct Surface*);
+void update_model_instance_matrix(struct ModelInstance*);
 void tick_model_instance(struct ModelInstance*);
 void submit_model_instance(struct ModelInstance*);
 void draw_model_instance(struct ModelInstance*);
+
+// Crowds
+struct Crowd* create_crowd(bool, struct Model*, struct Animation*);
+void dispose_crowd(struct Crowd*);
+void destroy_crowd(struct Crowd*);
+void add_crowd_instance(struct Crowd*, vec3, vec3, vec3, float, float);
+void clear_crowd(struct Crowd*);
+void draw_crowd(struct Crowd*);